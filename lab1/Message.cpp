@@ -3,21 +3,44 @@
 // 解决 'localtime' 警告
 #define _CRT_SECURE_NO_WARNINGS 
 
-#include "message.h"
+#include "Message.h"
+#include "framing.h"
 #include <cstdio>
 #include <cstring>
 #include <ctime> // 引入 time.h
 #include <string>
 
+// x86-64 一定支持 SSE2，用它加速字符串扫描
+#if defined(__SSE2__) || defined(_M_X64)
+#define MESSAGE_SIMD_SSE2
+#include <emmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+static inline unsigned count_trailing_zeros(unsigned x) {
+    unsigned long idx;
+    _BitScanForward(&idx, x);
+    return idx;
+}
+#else
+static inline unsigned count_trailing_zeros(unsigned x) { return __builtin_ctz(x); }
+#endif
+#endif
+
 // 实现缺失的时间获取函数
 std::string get_current_time() {
     char time_str[64];
     time_t now = time(0);
-    struct tm* ltm = localtime(&now);
+    // localtime 返回共享的静态缓冲区，多线程同时调用会互相覆盖，改用可重入版本
+    struct tm ltm;
+#ifdef _WIN32
+    localtime_s(&ltm, &now);
+#else
+    localtime_r(&now, &ltm);
+#endif
 
     // 格式化时间为 HH:MM:SS
     snprintf(time_str, sizeof(time_str), "%02d:%02d:%02d",
-        ltm->tm_hour, ltm->tm_min, ltm->tm_sec);
+        ltm.tm_hour, ltm.tm_min, ltm.tm_sec);
     return std::string(time_str);
 }
 
@@ -29,63 +52,516 @@ Message::Message(const std::string& t, const std::string& u, const std::string&
     : type(t), user(u), msg(m), time(tm) {
 }
 
-// from_json 实现（与您提供的文件内容一致）
-Message Message::from_json(const std::string& json) {
-    Message msg_obj;
-    msg_obj.type = extract_value_robust(json, "type");
-    msg_obj.user = extract_value_robust(json, "user");
-    msg_obj.msg = extract_value_robust(json, "msg");
-    msg_obj.time = extract_value_robust(json, "time");
-    return msg_obj;
+// from_json：MessageView 单遍解析后解码转义，得到拥有数据的 Message
+Message Message::from_json(std::string_view json) {
+    MessageView view;
+    view.parse(json);
+    return view.toMessage();
 }
 
-// toString 实现（与您提供的文件内容一致）
-std::string Message::toString() const {
-    const int MAX_BUFFER_SIZE = 5 * 1024;
-    char* buffer = new char[MAX_BUFFER_SIZE];
+// JSON 固定部分：{"type":"","user":"","msg":"","time":""}
+static const char JSON_KEY_TYPE[] = "{\"type\":\"";
+static const char JSON_KEY_USER[] = "\",\"user\":\"";
+static const char JSON_KEY_MSG[]  = "\",\"msg\":\"";
+static const char JSON_KEY_TIME[] = "\",\"time\":\"";
+static const char JSON_TAIL[]     = "\"}";
+static const size_t JSON_FIXED_SIZE = sizeof(JSON_KEY_TYPE) + sizeof(JSON_KEY_USER) +
+    sizeof(JSON_KEY_MSG) + sizeof(JSON_KEY_TIME) + sizeof(JSON_TAIL) - 5;
+
+static char* append_raw(char* out, const char* s, size_t n) {
+    memcpy(out, s, n);
+    return out + n;
+}
+
+static char* append_view(char* out, std::string_view v) {
+    return append_raw(out, v.data(), v.size());
+}
 
-    int required_size = snprintf(buffer, MAX_BUFFER_SIZE,
-        "{\"type\":\"%s\",\"user\":\"%s\",\"msg\":\"%s\",\"time\":\"%s\"}",
-        type.c_str(), user.c_str(), msg.c_str(), time.c_str());
+// 需要转义的字符：引号、反斜杠以及控制字符
+static inline bool needs_escape(unsigned char c) {
+    return c == '"' || c == '\\' || c < 0x20;
+}
 
-    std::string result(buffer);
-    delete[] buffer;
+static size_t escaped_size(std::string_view s) {
+    size_t n = s.size();
+    for (unsigned char c : s) {
+        if (!needs_escape(c)) continue;
+        switch (c) {
+        case '"': case '\\': case '\b': case '\f': case '\n': case '\r': case '\t':
+            n += 1;
+            break;
+        default:
+            n += 5;  // \u00XX
+        }
+    }
+    return n;
+}
+
+static char* append_escaped(char* out, std::string_view s) {
+    static const char HEX[] = "0123456789abcdef";
+    for (unsigned char c : s) {
+        if (!needs_escape(c)) {
+            *out++ = static_cast<char>(c);
+            continue;
+        }
+        *out++ = '\\';
+        switch (c) {
+        case '"':  *out++ = '"'; break;
+        case '\\': *out++ = '\\'; break;
+        case '\b': *out++ = 'b'; break;
+        case '\f': *out++ = 'f'; break;
+        case '\n': *out++ = 'n'; break;
+        case '\r': *out++ = 'r'; break;
+        case '\t': *out++ = 't'; break;
+        default:
+            *out++ = 'u'; *out++ = '0'; *out++ = '0';
+            *out++ = HEX[c >> 4]; *out++ = HEX[c & 0xF];
+        }
+    }
+    return out;
+}
+
+// 四个字段编码成 JSON 的长度；escape 为 false 表示字段已是 JSON 转义形式，原样写入
+static size_t json_body_size(std::string_view t, std::string_view u, std::string_view m,
+                             std::string_view tm, bool escape) {
+    if (!escape) return JSON_FIXED_SIZE + t.size() + u.size() + m.size() + tm.size();
+    return JSON_FIXED_SIZE + escaped_size(t) + escaped_size(u) + escaped_size(m) + escaped_size(tm);
+}
+
+static void write_json_body(char* out, std::string_view t, std::string_view u, std::string_view m,
+                            std::string_view tm, bool escape) {
+    char* (*put)(char*, std::string_view) = escape ? append_escaped : append_view;
+    out = append_raw(out, JSON_KEY_TYPE, sizeof(JSON_KEY_TYPE) - 1);
+    out = put(out, t);
+    out = append_raw(out, JSON_KEY_USER, sizeof(JSON_KEY_USER) - 1);
+    out = put(out, u);
+    out = append_raw(out, JSON_KEY_MSG, sizeof(JSON_KEY_MSG) - 1);
+    out = put(out, m);
+    out = append_raw(out, JSON_KEY_TIME, sizeof(JSON_KEY_TIME) - 1);
+    out = put(out, tm);
+    append_raw(out, JSON_TAIL, sizeof(JSON_TAIL) - 1);
+}
+
+size_t Message::json_size() const {
+    return json_body_size(type, user, msg, time, true);
+}
+
+void Message::write_json(char* out) const {
+    write_json_body(out, type, user, msg, time, true);
+}
+
+// toString：按精确长度一次分配，不再借用 5KB 临时缓冲区
+std::string Message::toString() const {
+    std::string result(json_size(), '\0');
+    write_json(&result[0]);
     return result;
 }
 
-// extract_value_robust 实现（与您提供的文件内容一致）
-std::string Message::extract_value_robust(const std::string& json, const std::string& key) {
-    std::string pattern = "\"" + key + "\":\"";
-    size_t start_pos = json.find(pattern);
-    if (start_pos == std::string::npos) {
-        return "";
+// toFrame：长度头 + JSON 直接编码进帧内存，整个过程只有一次分配。
+// 分帧连接发送整个帧，旧协议连接跳过长度头只发 JSON
+FrameRef Message::toFrame() const {
+    size_t body = json_size();
+    char* out;
+    FrameRef frame = Frame::alloc(FRAME_HEADER_LEN + body, &out, FRAME_HEADER_LEN);
+    put_frame_header(out, static_cast<std::uint32_t>(body));
+    write_json(out + FRAME_HEADER_LEN);
+    return frame;
+}
+
+// ======================= 二进制编码 =======================
+// 消息体格式（外层仍是 4 字节长度头）：
+//   tag   1 字节：0x80 | (时间为任意字符串 ? 0x40 : 0) | 类型编号，编号 0 表示自定义类型
+//   type  仅自定义类型时出现：varint 长度 + 字节
+//   user  varint 长度 + 字节
+//   msg   varint 长度 + 字节
+//   time  HH:MM:SS 编码为当天秒数的 varint，否则为 varint 长度 + 字节
+// tag 最高位为 1，而 JSON 只能以空白或 '{' 开头，因此每帧都能按首字节区分编码
+
+#define BIN_TAG_MARK       0x80
+#define BIN_TAG_TIME_STR   0x40
+#define BIN_TAG_CODE_MASK  0x3F
+
+static const char* const TYPE_NAMES[] = {
+    "", "login", "chat", "logout", "system", "error", "codec", "join", "part"
+};
+static const size_t TYPE_COUNT = sizeof(TYPE_NAMES) / sizeof(TYPE_NAMES[0]);
+
+static unsigned type_code(std::string_view type) {
+    for (size_t i = 1; i < TYPE_COUNT; ++i) {
+        if (type == TYPE_NAMES[i]) return static_cast<unsigned>(i);
     }
+    return 0;
+}
 
-    size_t value_start = start_pos + pattern.length();
-    if (value_start >= json.length()) {
-        return "";
+static size_t varint_size(std::uint64_t v) {
+    size_t n = 1;
+    while (v >= 0x80) { v >>= 7; ++n; }
+    return n;
+}
+
+static char* put_varint(char* out, std::uint64_t v) {
+    while (v >= 0x80) {
+        *out++ = static_cast<char>((v & 0x7F) | 0x80);
+        v >>= 7;
     }
+    *out++ = static_cast<char>(v);
+    return out;
+}
 
-    size_t value_end = value_start;
-    bool in_escape = false;
+static const char* get_varint(const char* p, const char* end, std::uint64_t* v) {
+    std::uint64_t result = 0;
+    for (int shift = 0; p < end && shift < 64; shift += 7) {
+        unsigned char b = static_cast<unsigned char>(*p++);
+        result |= std::uint64_t(b & 0x7F) << shift;
+        if (!(b & 0x80)) {
+            *v = result;
+            return p;
+        }
+    }
+    return nullptr;
+}
+
+// "HH:MM:SS" 转成当天秒数，格式不符返回 false
+static bool parse_clock(std::string_view t, std::uint32_t* secs) {
+    if (t.size() != 8 || t[2] != ':' || t[5] != ':') return false;
+    for (size_t i : { 0, 1, 3, 4, 6, 7 }) {
+        if (t[i] < '0' || t[i] > '9') return false;
+    }
+    unsigned h = (t[0] - '0') * 10 + (t[1] - '0');
+    unsigned m = (t[3] - '0') * 10 + (t[4] - '0');
+    unsigned sec = (t[6] - '0') * 10 + (t[7] - '0');
+    if (h > 23 || m > 59 || sec > 59) return false;
+    *secs = h * 3600 + m * 60 + sec;
+    return true;
+}
+
+static void format_clock(std::uint32_t secs, char out[8]) {
+    unsigned h = secs / 3600, m = secs / 60 % 60, sec = secs % 60;
+    out[0] = static_cast<char>('0' + h / 10); out[1] = static_cast<char>('0' + h % 10); out[2] = ':';
+    out[3] = static_cast<char>('0' + m / 10); out[4] = static_cast<char>('0' + m % 10); out[5] = ':';
+    out[6] = static_cast<char>('0' + sec / 10); out[7] = static_cast<char>('0' + sec % 10);
+}
+
+static char* put_bytes(char* out, std::string_view v) {
+    out = put_varint(out, v.size());
+    return append_raw(out, v.data(), v.size());
+}
+
+// 字段均为解码后的内容
+static size_t binary_body_size(std::string_view t, std::string_view u, std::string_view m,
+                               std::string_view tm) {
+    size_t n = 1;
+    if (type_code(t) == 0) n += varint_size(t.size()) + t.size();
+    n += varint_size(u.size()) + u.size();
+    n += varint_size(m.size()) + m.size();
+    std::uint32_t secs;
+    n += parse_clock(tm, &secs) ? varint_size(secs) : varint_size(tm.size()) + tm.size();
+    return n;
+}
+
+static void write_binary_body(char* out, std::string_view t, std::string_view u, std::string_view m,
+                              std::string_view tm) {
+    unsigned code = type_code(t);
+    std::uint32_t secs;
+    bool clock = parse_clock(tm, &secs);
+    *out++ = static_cast<char>(BIN_TAG_MARK | (clock ? 0 : BIN_TAG_TIME_STR) | code);
+    if (code == 0) out = put_bytes(out, t);
+    out = put_bytes(out, u);
+    out = put_bytes(out, m);
+    if (clock) put_varint(out, secs);
+    else put_bytes(out, tm);
+}
+
+static FrameRef make_binary_frame(std::string_view t, std::string_view u, std::string_view m,
+                                  std::string_view tm) {
+    size_t body = binary_body_size(t, u, m, tm);
+    char* out;
+    FrameRef frame = Frame::alloc(FRAME_HEADER_LEN + body, &out, FRAME_HEADER_LEN);
+    put_frame_header(out, static_cast<std::uint32_t>(body));
+    write_binary_body(out + FRAME_HEADER_LEN, t, u, m, tm);
+    return frame;
+}
+
+FrameRef Message::toBinaryFrame() const {
+    return make_binary_frame(type, user, msg, time);
+}
+
+FrameRef Message::toFrame(Codec codec) const {
+    return codec == Codec::Binary ? toBinaryFrame() : toFrame();
+}
+
+Message Message::decode(std::string_view payload) {
+    MessageView view;
+    view.parse(payload);
+    return view.toMessage();
+}
 
-    for (; value_end < json.length(); ++value_end) {
-        char current_char = json[value_end];
-        if (in_escape) {
-            in_escape = false;
+// ======================= MessageView =======================
+
+// 找到下一个引号或反斜杠，没有则返回 end。字符串扫描是解析的主要开销，
+// 支持 SSE2 时一次比较 16 字节
+static const char* find_quote_or_backslash(const char* p, const char* end) {
+#ifdef MESSAGE_SIMD_SSE2
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i slash = _mm_set1_epi8('\\');
+    while (end - p >= 16) {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, quote),
+                                                  _mm_cmpeq_epi8(chunk, slash)));
+        if (mask) return p + count_trailing_zeros(static_cast<unsigned>(mask));
+        p += 16;
+    }
+#endif
+    while (p < end && *p != '"' && *p != '\\') ++p;
+    return p;
+}
+
+// 扫描 JSON 字符串内容（p 指向开引号之后），返回闭引号位置，不完整时返回 nullptr
+static const char* scan_string(const char* p, const char* end, bool* escaped) {
+    while (true) {
+        p = find_quote_or_backslash(p, end);
+        if (p == end) return nullptr;
+        if (*p == '"') return p;
+        *escaped = true;
+        p += 2;  // 跳过反斜杠及其后的字符
+        if (p > end) return nullptr;
+    }
+}
+
+static const char* skip_ws(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r')) ++p;
+    return p;
+}
+
+// 跳过一个非字符串的值（数字、true/false/null、嵌套对象或数组），停在其后的 ',' 或 '}'
+static const char* skip_value(const char* p, const char* end) {
+    int depth = 0;
+    bool escaped = false;
+    for (; p < end; ++p) {
+        char c = *p;
+        if (c == '"') {
+            p = scan_string(p + 1, end, &escaped);
+            if (!p) return nullptr;
         }
-        else if (current_char == '\\') {
-            in_escape = true;
+        else if (c == '{' || c == '[') ++depth;
+        else if (c == '}' || c == ']') {
+            if (depth == 0) return p;
+            --depth;
         }
-        else if (current_char == '\"') {
+        else if (c == ',' && depth == 0) return p;
+    }
+    return nullptr;
+}
+
+void MessageView::reset() {
+    type_ = user_ = msg_ = time_ = std::string_view();
+    escaped_ = false;
+    json_ = true;
+}
+
+bool MessageView::parse(std::string_view payload) {
+    reset();
+    if (!payload.empty() && (static_cast<unsigned char>(payload[0]) & BIN_TAG_MARK)) {
+        return parse_binary(payload);
+    }
+    return parse_json(payload);
+}
+
+bool MessageView::parse_binary(std::string_view payload) {
+    json_ = false;
+    const char* p = payload.data();
+    const char* end = p + payload.size();
+    unsigned tag = static_cast<unsigned char>(*p++);
+
+    // 读取 varint 长度 + 字节，返回 false 表示截断
+    auto get_bytes = [&](std::string_view* out) {
+        std::uint64_t len;
+        p = get_varint(p, end, &len);
+        if (!p || len > std::uint64_t(end - p)) return false;
+        *out = std::string_view(p, static_cast<size_t>(len));
+        p += len;
+        return true;
+    };
+
+    unsigned code = tag & BIN_TAG_CODE_MASK;
+    if (code == 0) {
+        if (!get_bytes(&type_)) return false;
+    }
+    else if (code < TYPE_COUNT) {
+        type_ = TYPE_NAMES[code];
+    }
+    if (!get_bytes(&user_) || !get_bytes(&msg_)) return false;
+    if (tag & BIN_TAG_TIME_STR) return get_bytes(&time_);
+
+    std::uint64_t secs;
+    p = get_varint(p, end, &secs);
+    if (!p || secs >= 86400) return false;
+    format_clock(static_cast<std::uint32_t>(secs), time_buf_);
+    time_ = std::string_view(time_buf_, sizeof(time_buf_));
+    return true;
+}
+
+bool MessageView::parse_json(std::string_view json) {
+    const char* p = json.data();
+    const char* end = p + json.size();
+
+    p = skip_ws(p, end);
+    if (p == end || *p != '{') return false;
+    ++p;
+
+    while (true) {
+        p = skip_ws(p, end);
+        if (p == end) return false;
+        if (*p == '}') return true;
+        if (*p != '"') return false;
+
+        // 键
+        bool key_escaped = false;
+        const char* key = p + 1;
+        const char* q = scan_string(key, end, &key_escaped);
+        if (!q) return false;
+        std::string_view name(key, q - key);
+
+        p = skip_ws(q + 1, end);
+        if (p == end || *p != ':') return false;
+        p = skip_ws(p + 1, end);
+        if (p == end) return false;
+
+        // 值：只关心四个字符串字段，其他值直接跳过
+        if (*p == '"') {
+            const char* val = p + 1;
+            bool val_escaped = false;
+            q = scan_string(val, end, &val_escaped);
+            if (!q) return false;
+            std::string_view field(val, q - val);
+            if (name == "type") type_ = field;
+            else if (name == "user") user_ = field;
+            else if (name == "msg") msg_ = field;
+            else if (name == "time") time_ = field;
+            escaped_ = escaped_ || val_escaped;
+            p = q + 1;
+        }
+        else {
+            p = skip_value(p, end);
+            if (!p) return false;
+        }
+
+        p = skip_ws(p, end);
+        if (p == end) return false;
+        if (*p == ',') { ++p; continue; }
+        return *p == '}';
+    }
+}
+
+static void append_utf8(std::string& out, unsigned long cp) {
+    if (cp < 0x80) {
+        out += static_cast<char>(cp);
+    }
+    else if (cp < 0x800) {
+        out += static_cast<char>(0xC0 | (cp >> 6));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    else if (cp < 0x10000) {
+        out += static_cast<char>(0xE0 | (cp >> 12));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+    else {
+        out += static_cast<char>(0xF0 | (cp >> 18));
+        out += static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+        out += static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+        out += static_cast<char>(0x80 | (cp & 0x3F));
+    }
+}
+
+static bool parse_hex4(const char* p, const char* end, unsigned long* out) {
+    if (end - p < 4) return false;
+    unsigned long v = 0;
+    for (int i = 0; i < 4; ++i) {
+        char c = p[i];
+        v <<= 4;
+        if (c >= '0' && c <= '9') v |= c - '0';
+        else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+        else return false;
+    }
+    *out = v;
+    return true;
+}
+
+std::string MessageView::unescape(std::string_view raw) {
+    std::string out;
+    out.reserve(raw.size());
+    const char* p = raw.data();
+    const char* end = p + raw.size();
+    while (p < end) {
+        const char* run = p;
+        while (p < end && *p != '\\') ++p;
+        out.append(run, p - run);
+        if (p + 1 >= end) break;  // 末尾孤立的反斜杠直接丢弃
+
+        char c = p[1];
+        p += 2;
+        switch (c) {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+            unsigned long cp;
+            if (!parse_hex4(p, end, &cp)) break;
+            p += 4;
+            // UTF-16 代理对
+            unsigned long lo;
+            if (cp >= 0xD800 && cp < 0xDC00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u' &&
+                parse_hex4(p + 2, end, &lo) && lo >= 0xDC00 && lo < 0xE000) {
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                p += 6;
+            }
+            append_utf8(out, cp);
             break;
         }
+        default:
+            out += c;  // \" \\ \/ 以及未知转义都取字符本身
+        }
     }
+    return out;
+}
+
+Message MessageView::toMessage() const {
+    if (!json_ || !escaped_) {
+        return Message(std::string(type_), std::string(user_), std::string(msg_), std::string(time_));
+    }
+    return Message(unescape(type_), unescape(user_), unescape(msg_), unescape(time_));
+}
 
-    if (value_end == json.length()) {
-        return "";
+// JSON 视图的字段已是转义形式，原样拷贝；二进制视图的字段是原文，需要转义
+FrameRef MessageView::toFrame() const {
+    size_t body = json_body_size(type_, user_, msg_, time_, !json_);
+    char* out;
+    FrameRef frame = Frame::alloc(FRAME_HEADER_LEN + body, &out, FRAME_HEADER_LEN);
+    put_frame_header(out, static_cast<std::uint32_t>(body));
+    write_json_body(out + FRAME_HEADER_LEN, type_, user_, msg_, time_, !json_);
+    return frame;
+}
+
+FrameRef MessageView::toBinaryFrame() const {
+    if (json_ && escaped_) {
+        // 少见情况：JSON 字段带转义，先解码再编码
+        return toMessage().toBinaryFrame();
     }
+    return make_binary_frame(type_, user_, msg_, time_);
+}
 
-    size_t len = value_end - value_start;
-    return json.substr(value_start, len);
-}
\ No newline at end of file
+FrameRef MessageView::toFrame(Codec codec) const {
+    return codec == Codec::Binary ? toBinaryFrame() : toFrame();
+}
+
+// ======================= FrameSet =======================
+
+const FrameRef& FrameSet::get(Codec codec) {
+    FrameRef& slot = codec == Codec::Binary ? binary_ : json_;
+    if (!slot) slot = view_ ? view_->toFrame(codec) : msg_->toFrame(codec);
+    return slot;
+}
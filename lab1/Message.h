@@ -1,17 +1,37 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+#include <utility>
+
+#include "frame.h"
 
 std::string get_current_time();
 
+// 消息编码：JSON 为默认和兜底；Binary 为紧凑二进制编码（类型编号 + varint 长度 + 数值时间），
+// 在 login 时协商：客户端在 login 的 msg 中写 "binary" 表示支持，服务器回复一条
+// type 为 "codec"、msg 为 "binary" 的消息后，双方即可发送二进制帧。
+// 每帧按首字节区分编码，因此切换前后的消息可以混在一起
+enum class Codec : std::uint8_t {
+    Json,
+    Binary
+};
+
+inline constexpr std::string_view CODEC_BINARY = "binary";
+
+// 消息类型：客户端发送 login、chat、logout，以及 join（msg 为房间名）和 part（回到默认房间）；
+// 服务器发送 system、error 和 codec
 class Message {
 public:
     Message();
     // 使用 Getter 避免直接访问私有成员
     Message(const std::string& t, const std::string& u, const std::string& m, const std::string& tm);
 
-    // 修正：统一使用 from_json
-    static Message from_json(const std::string& json);
+    // 修正：统一使用 from_json（内部使用 MessageView 单遍解析，并解码转义字符）
+    static Message from_json(std::string_view json);
+    // 解码一帧正文，自动识别 JSON 或二进制编码
+    static Message decode(std::string_view payload);
 
     // Getter 方法
     const std::string& getType() const { return type; }
@@ -19,13 +39,86 @@ public:
     const std::string& getMsg() const { return msg; }
     const std::string& getTime() const { return time; }
 
-    // 修正：统一使用 toString
+    // 修正：统一使用 toString（字段中的引号、反斜杠和控制字符会被转义）
     std::string toString() const;
 
+    // 编码成不可变的共享帧（长度头 + JSON），广播时所有接收者共用这一份
+    FrameRef toFrame() const;
+    // 长度头 + 二进制编码
+    FrameRef toBinaryFrame() const;
+    FrameRef toFrame(Codec codec) const;
+
 private:
     std::string type;
     std::string user;
     std::string msg;
     std::string time;
-    static std::string extract_value_robust(const std::string& json, const std::string& key);
-};
\ No newline at end of file
+
+    // JSON 编码后的精确长度，以及写入预先分配好的缓冲区
+    size_t json_size() const;
+    void write_json(char* out) const;
+};
+
+// 零拷贝的消息视图：字段直接指向接收缓冲区，只在缓冲区有效期内可用。
+// 解析只扫描一遍、不分配内存；JSON 字段保持转义形式，需要时才解码
+class MessageView {
+public:
+    MessageView() = default;
+    // 二进制消息的时间字段指向内部缓冲区，禁止拷贝以免视图悬空
+    MessageView(const MessageView&) = delete;
+    MessageView& operator=(const MessageView&) = delete;
+
+    // 单遍解析一帧正文（自动识别 JSON 或二进制），格式错误时返回 false（已解析出的字段仍然保留）
+    bool parse(std::string_view payload);
+
+    // 原始字段（JSON 消息为转义形式，二进制消息为原文）
+    std::string_view type() const { return type_; }
+    std::string_view user() const { return user_; }
+    std::string_view msg() const { return msg_; }
+    std::string_view time() const { return time_; }
+
+    // 是否有字段包含转义序列；没有时原始字段就是解码后的内容
+    bool escaped() const { return json_ && escaped_; }
+    Codec codec() const { return json_ ? Codec::Json : Codec::Binary; }
+
+    // 解码一个原始字段中的转义序列
+    static std::string unescape(std::string_view raw);
+
+    // 转换为拥有数据的 Message：解码并拷贝各字段
+    Message toMessage() const;
+
+    // 直接用原始字段编码成帧，转义原样保留，转发时无需解码再编码
+    FrameRef toFrame() const;
+    FrameRef toBinaryFrame() const;
+    FrameRef toFrame(Codec codec) const;
+
+private:
+    void reset();
+    bool parse_json(std::string_view json);
+    bool parse_binary(std::string_view payload);
+
+    std::string_view type_;
+    std::string_view user_;
+    std::string_view msg_;
+    std::string_view time_;
+    bool escaped_ = false;
+    bool json_ = true;
+    char time_buf_[8];  // 二进制消息中数值时间格式化后的 HH:MM:SS
+};
+
+// 一条待广播的消息：按接收者使用的编码各编码一次，之后所有同编码的接收者共享同一帧
+class FrameSet {
+public:
+    explicit FrameSet(const Message& msg) : msg_(&msg) {}
+    explicit FrameSet(const MessageView& view) : view_(&view) {}
+    // 已编码好的帧（跨线程转发时使用），两种编码都必须给出
+    FrameSet(FrameRef json, FrameRef binary) : json_(std::move(json)), binary_(std::move(binary)) {}
+
+    const FrameRef& get(Codec codec);
+
+private:
+    const Message* msg_ = nullptr;
+    const MessageView* view_ = nullptr;
+    FrameRef json_;
+    FrameRef binary_;
+};
@@ -0,0 +1,46 @@
+// asynclog.cpp -- 后台日志线程
+#include "asynclog.h"
+
+AsyncLog chat_log;
+
+AsyncLog::~AsyncLog() {
+    if (!started_) return;
+    stop_ = true;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending_ = true;
+    }
+    cv_.notify_one();
+    thread_.join();
+}
+
+void AsyncLog::start(FILE* out) {
+    out_ = out;
+    started_ = true;
+    thread_ = std::thread([this] { run(); });
+}
+
+void AsyncLog::write(std::string line) {
+    line += '\n';
+    queue_.push(std::move(line));
+    if (!pending_.exchange(true)) {
+        // 加锁后再通知：后台线程要么还没开始等待，要么一定能收到
+        { std::lock_guard<std::mutex> lock(mutex_); }
+        cv_.notify_one();
+    }
+}
+
+void AsyncLog::run() {
+    std::string line;
+    while (1) {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return pending_.load(); });
+        }
+        // 先清标记再取队列，之后写入的行会再次唤醒
+        pending_.store(false);
+        while (queue_.pop(line)) fwrite(line.data(), 1, line.size(), out_);
+        fflush(out_);
+        if (stop_) return;
+    }
+}
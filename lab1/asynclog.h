@@ -0,0 +1,55 @@
+#pragma once
+
+// asynclog.h -- 后台线程写出的文本日志，用于可选的逐条聊天输出
+// 调用方只把整行放进无锁队列，后台线程批量写到 stdout 并在每批结束时刷新一次，
+// 广播路径上不再有同步的 cout << endl。未启动时 enabled() 为 false，调用方连字符串都不用拼
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "mpsc_queue.h"
+
+class AsyncLog {
+public:
+    AsyncLog() = default;
+    ~AsyncLog();
+
+    AsyncLog(const AsyncLog&) = delete;
+    AsyncLog& operator=(const AsyncLog&) = delete;
+
+    void start(FILE* out);
+    bool enabled() const { return started_; }
+
+    // 任意线程调用，line 不含换行
+    void write(std::string line);
+
+private:
+    void run();
+
+    FILE* out_ = nullptr;
+    bool started_ = false;
+    MpscQueue<std::string> queue_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::atomic<bool> pending_{ false };  // 已通知且后台线程尚未取走，避免每行一次唤醒
+    std::atomic<bool> stop_{ false };
+    std::thread thread_;
+};
+
+// --print-chat 时启动，记录每条聊天消息
+extern AsyncLog chat_log;
+
+// 聊天日志的一行：[时间] #房间 用户: 内容
+inline std::string chat_line(std::string_view time, std::string_view room, std::string_view user,
+                             std::string_view msg) {
+    std::string line;
+    line.reserve(time.size() + room.size() + user.size() + msg.size() + 8);
+    line.append("[").append(time).append("] #").append(room);
+    line.append(" ").append(user).append(": ").append(msg);
+    return line;
+}
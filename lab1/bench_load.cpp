@@ -0,0 +1,470 @@
+// bench_load.cpp -- 聊天服务器压测工具（仅 Linux）：模拟 N 个客户端，测量广播端到端延迟与吞吐
+// g++ -std=c++17 -O2 -o bench_load bench_load.cpp Message.cpp -pthread
+// 用法：bench_load [--host IP] [--port N | --ports A,B,...] [--clients N] [--senders N] [--rate MSG/S] [--size BYTES]
+//                  [--duration S] [--warmup S] [--threads N] [--rooms N] [--binary]
+//                  [--label TEXT] [--csv FILE]
+//
+// 所有客户端通过回环地址连接并登录，前 senders 个客户端按总速率 rate 轮流发送聊天消息，
+// 消息正文以发送时刻的 steady_clock 纳秒数开头，收到广播的每个客户端据此计算一次延迟。
+// --ports 时客户端轮流连接各个端口（例如互联的多个服务器实例），延迟中包含实例间转发的开销。
+// 结果以 CSV 输出（--csv 时追加到文件，文件为空时先写表头），便于跟踪回归
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Message.h"
+#include "framing.h"
+
+using std::string;
+using std::vector;
+
+#define BUFFER_SIZE (64 * 1024)
+#define MAX_EVENTS 256
+#define SETUP_TIMEOUT_S 60  // 等待全部客户端登录完成的上限
+#define DRAIN_GRACE_MS 1000 // 停止发送后继续接收的时间，收齐在途消息
+
+struct Options {
+    string host = "127.0.0.1";
+    vector<unsigned short> ports{ 8080 };  // 第 i 个客户端连接 ports[i % 端口数]
+    int clients = 100;
+    int senders = -1;       // 默认全部客户端都发送
+    double rate = 1000;     // 所有发送者合计每秒消息数
+    size_t size = 64;       // 聊天正文字节数（含时间戳）
+    double duration = 10;   // 计入统计的发送时长
+    double warmup = 1;      // 预热时长，期间发送的消息不计入
+    int threads = 0;        // 收发线程数，0 表示 CPU 核心数
+    int rooms = 1;          // 客户端均匀分到多少个房间
+    bool binary = false;    // 登录时协商二进制编码
+    string label;
+    string csv;
+};
+
+static std::int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+struct BenchClient {
+    int fd = -1;
+    string name;
+    string room;              // 空表示留在默认房间
+    bool logged_in = false;   // 已收到自己的登录广播
+    bool ready = false;       // 已进入目标房间
+    bool binary = false;      // 服务器已确认二进制编码
+    StreamDecoder decoder{ WireMode::Framed };
+};
+
+// 各线程的统计，结束后合并
+struct WorkerStats {
+    vector<std::uint32_t> latency_us;
+    std::uint64_t sent = 0;        // 统计窗口内发出的消息
+    std::uint64_t send_fail = 0;   // 发送缓冲区满而放弃的消息
+    std::uint64_t delivered = 0;   // 统计窗口内收到的广播
+};
+
+// 收发线程之间共享的阶段时间点
+struct Phases {
+    std::atomic<int> ready{ 0 };                // 已就绪的客户端数
+    std::atomic<std::int64_t> send_start{ 0 };  // 开始发送的时刻，0 表示还在登录阶段
+    std::int64_t measure_start = 0;
+    std::int64_t send_end = 0;
+};
+
+static bool send_all(int fd, const FrameRef& frame) {
+    const char* p = frame->data();
+    size_t left = frame->size();
+    while (left > 0) {
+        ssize_t n = send(fd, p, left, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += n;
+        left -= n;
+    }
+    return true;
+}
+
+class Worker {
+public:
+    Worker(const Options& opt, Phases& phases) : opt_(opt), phases_(phases) {}
+
+    bool init();
+    // 线程运行期间由主线程调用；senders_ 只在发送阶段开始后才被读取
+    bool add(BenchClient* c, bool sender);
+    void run();
+    WorkerStats& stats() { return stats_; }
+
+private:
+    void on_readable(BenchClient* c);
+    void on_message(BenchClient* c, const MessageView& m);
+    void send_due(std::int64_t now);
+
+    const Options& opt_;
+    Phases& phases_;
+    int epfd_ = -1;
+    vector<BenchClient*> senders_;
+    size_t next_sender_ = 0;
+    std::int64_t next_send_ = 0;
+    std::int64_t interval_ns_ = 0;
+    WorkerStats stats_;
+    string body_;  // 复用的正文缓冲区
+    char rbuf_[BUFFER_SIZE];
+};
+
+bool Worker::init() {
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+    return epfd_ >= 0;
+}
+
+bool Worker::add(BenchClient* c, bool sender) {
+    if (sender) senders_.push_back(c);
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = c;
+    return epoll_ctl(epfd_, EPOLL_CTL_ADD, c->fd, &ev) == 0;
+}
+
+void Worker::on_message(BenchClient* c, const MessageView& m) {
+    if (m.type() == "chat") {
+        // 正文格式：发送时刻纳秒数 + '|' + 填充
+        std::string_view body = m.msg();
+        std::int64_t sent_at = 0;
+        size_t i = 0;
+        for (; i < body.size() && body[i] >= '0' && body[i] <= '9'; ++i) {
+            sent_at = sent_at * 10 + (body[i] - '0');
+        }
+        if (i == 0 || sent_at < phases_.measure_start || sent_at >= phases_.send_end) return;
+        stats_.latency_us.push_back(static_cast<std::uint32_t>((now_ns() - sent_at) / 1000));
+        ++stats_.delivered;
+    }
+    else if (m.type() == "codec") {
+        c->binary = (m.msg() == CODEC_BINARY);
+    }
+    else if (m.type() == "system" && !c->ready) {
+        // 只关心自己的登录和进房间通知
+        if (!c->logged_in && m.msg() == c->name + " joined.") {
+            c->logged_in = true;
+            if (c->room.empty()) {
+                c->ready = true;
+            }
+            else {
+                Message join("join", c->name, c->room, get_current_time());
+                send_all(c->fd, join.toFrame(c->binary ? Codec::Binary : Codec::Json));
+            }
+        }
+        else if (c->logged_in && m.msg() == c->name + " joined #" + c->room + ".") {
+            c->ready = true;
+        }
+        if (c->ready) phases_.ready.fetch_add(1);
+    }
+}
+
+void Worker::on_readable(BenchClient* c) {
+    while (1) {
+        ssize_t n = recv(c->fd, rbuf_, BUFFER_SIZE, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return;  // EAGAIN：已读空
+        }
+        if (n == 0) {
+            fprintf(stderr, "%s: server closed the connection.\n", c->name.c_str());
+            epoll_ctl(epfd_, EPOLL_CTL_DEL, c->fd, nullptr);
+            return;
+        }
+        c->decoder.feed(rbuf_, n, [&](std::string_view payload) {
+            MessageView view;
+            view.parse(payload);
+            on_message(c, view);
+        });
+        if (n < BUFFER_SIZE) return;
+    }
+}
+
+// 按节拍发出到期的消息；落后太多时放弃追赶，避免瞬间突发
+void Worker::send_due(std::int64_t now) {
+    if (senders_.empty()) return;
+    if (now - next_send_ > 100 * 1000000LL) next_send_ = now;
+    while (next_send_ <= now && next_send_ < phases_.send_end) {
+        BenchClient* c = senders_[next_sender_];
+        next_sender_ = (next_sender_ + 1) % senders_.size();
+
+        std::int64_t t = now_ns();
+        body_ = std::to_string(t);
+        body_ += '|';
+        if (body_.size() < opt_.size) body_.append(opt_.size - body_.size(), 'x');
+        Message chat("chat", c->name, body_, get_current_time());
+        FrameRef frame = chat.toFrame(c->binary ? Codec::Binary : Codec::Json);
+
+        ssize_t n = send(c->fd, frame->data(), frame->size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n == static_cast<ssize_t>(frame->size())) {
+            if (t >= phases_.measure_start) ++stats_.sent;
+        }
+        else if (n <= 0) {
+            ++stats_.send_fail;
+        }
+        else {
+            // 写了半帧，剩下的必须写完，否则后续帧全部错位
+            const char* p = frame->data() + n;
+            size_t left = frame->size() - n;
+            while (left > 0) {
+                ssize_t m = send(c->fd, p, left, MSG_NOSIGNAL);
+                if (m < 0 && errno != EINTR && errno != EAGAIN) break;
+                if (m > 0) { p += m; left -= m; }
+            }
+            if (t >= phases_.measure_start) ++stats_.sent;
+        }
+        next_send_ += interval_ns_;
+    }
+}
+
+void Worker::run() {
+    epoll_event events[MAX_EVENTS];
+    bool sending = false;
+    while (1) {
+        std::int64_t now = now_ns();
+        int timeout_ms = 10;
+        if (!sending && phases_.send_start.load() != 0) {
+            // 登录阶段结束，按本线程的发送者占比分配速率
+            sending = true;
+            double share = opt_.senders > 0 ? opt_.rate * senders_.size() / opt_.senders : 0;
+            interval_ns_ = share > 0 ? static_cast<std::int64_t>(1e9 / share) : 0;
+            next_send_ = phases_.send_start.load();
+            if (interval_ns_ == 0) senders_.clear();
+        }
+        if (sending) {
+            if (now >= phases_.send_end + DRAIN_GRACE_MS * 1000000LL) break;
+            send_due(now);
+            if (!senders_.empty() && next_send_ < phases_.send_end) {
+                std::int64_t wait = next_send_ - now_ns();
+                timeout_ms = wait > 0 ? static_cast<int>((wait + 999999) / 1000000) : 0;
+            }
+        }
+        int n = epoll_wait(epfd_, events, MAX_EVENTS, timeout_ms);
+        for (int i = 0; i < n; ++i) {
+            on_readable(static_cast<BenchClient*>(events[i].data.ptr));
+        }
+    }
+    close(epfd_);
+}
+
+static void usage() {
+    fprintf(stderr,
+        "Usage: bench_load [--host IP] [--port N | --ports A,B,...] [--clients N] [--senders N]\n"
+        "                  [--rate MSG/S] [--size BYTES] [--duration S] [--warmup S] [--threads N]\n"
+        "                  [--rooms N] [--binary] [--label TEXT] [--csv FILE]\n");
+}
+
+static bool parse_args(int argc, char* argv[], Options& opt) {
+    for (int i = 1; i < argc; ++i) {
+        const char* a = argv[i];
+        bool has_value = i + 1 < argc;
+        if (!strcmp(a, "--binary")) opt.binary = true;
+        else if (!has_value) return false;
+        else if (!strcmp(a, "--host")) opt.host = argv[++i];
+        else if (!strcmp(a, "--port")) opt.ports = { (unsigned short)atoi(argv[++i]) };
+        else if (!strcmp(a, "--ports")) {
+            opt.ports.clear();
+            for (char* p = argv[++i]; *p; ) {
+                opt.ports.push_back((unsigned short)strtoul(p, &p, 10));
+                if (*p == ',') ++p;
+                else if (*p) return false;
+            }
+        }
+        else if (!strcmp(a, "--clients")) opt.clients = atoi(argv[++i]);
+        else if (!strcmp(a, "--senders")) opt.senders = atoi(argv[++i]);
+        else if (!strcmp(a, "--rate")) opt.rate = atof(argv[++i]);
+        else if (!strcmp(a, "--size")) opt.size = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(a, "--duration")) opt.duration = atof(argv[++i]);
+        else if (!strcmp(a, "--warmup")) opt.warmup = atof(argv[++i]);
+        else if (!strcmp(a, "--threads")) opt.threads = atoi(argv[++i]);
+        else if (!strcmp(a, "--rooms")) opt.rooms = atoi(argv[++i]);
+        else if (!strcmp(a, "--label")) opt.label = argv[++i];
+        else if (!strcmp(a, "--csv")) opt.csv = argv[++i];
+        else return false;
+    }
+    if (opt.clients <= 0 || opt.rooms <= 0 || opt.duration <= 0 || opt.ports.empty()) return false;
+    if (opt.senders < 0 || opt.senders > opt.clients) opt.senders = opt.clients;
+    if (opt.threads <= 0) opt.threads = std::max(1u, std::thread::hardware_concurrency());
+    opt.threads = std::min(opt.threads, opt.clients);
+    return true;
+}
+
+static BenchClient* connect_client(const Options& opt, const sockaddr_in& addr, int i) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) return nullptr;
+    if (connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    int on = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+    BenchClient* c = new BenchClient;
+    c->fd = fd;
+    c->name = "bench" + std::to_string(i);
+    if (opt.rooms > 1) c->room = "room" + std::to_string(i % opt.rooms);
+
+    Message login("login", c->name, opt.binary ? string(CODEC_BINARY) : "", get_current_time());
+    if (!send_all(fd, login.toFrame())) {
+        close(fd);
+        delete c;
+        return nullptr;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    return c;
+}
+
+static std::uint32_t percentile(const vector<std::uint32_t>& sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t idx = static_cast<size_t>(p * (sorted.size() - 1));
+    return sorted[idx];
+}
+
+int main(int argc, char* argv[]) {
+    Options opt;
+    if (!parse_args(argc, argv, opt)) {
+        usage();
+        return 1;
+    }
+    signal(SIGPIPE, SIG_IGN);
+
+    // 每个模拟客户端一个描述符
+    rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+
+    vector<sockaddr_in> addrs;
+    for (unsigned short port : opt.ports) {
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        if (inet_pton(AF_INET, opt.host.c_str(), &addr.sin_addr) != 1) {
+            fprintf(stderr, "Invalid host: %s\n", opt.host.c_str());
+            return 1;
+        }
+        addrs.push_back(addr);
+    }
+
+    Phases phases;
+    vector<Worker*> workers;
+    vector<std::thread> threads;
+    for (int i = 0; i < opt.threads; ++i) {
+        Worker* w = new Worker(opt, phases);
+        if (!w->init()) {
+            fprintf(stderr, "epoll_create1 failed.\n");
+            return 1;
+        }
+        workers.push_back(w);
+        threads.emplace_back([w] { w->run(); });
+    }
+
+    // 登录阶段：依次连接并发送 login，收发线程同时接收登录广播，全部进入房间后开始计时发送
+    vector<BenchClient*> clients;
+    std::int64_t t0 = now_ns();
+    for (int i = 0; i < opt.clients; ++i) {
+        BenchClient* c = connect_client(opt, addrs[i % addrs.size()], i);
+        if (!c || !workers[i % opt.threads]->add(c, i < opt.senders)) {
+            fprintf(stderr, "Connect failed after %d clients: %s\n", i, strerror(errno));
+            return 1;
+        }
+        clients.push_back(c);
+    }
+    std::int64_t t_connected = now_ns();
+    while (phases.ready.load() < opt.clients) {
+        if (now_ns() - t0 > SETUP_TIMEOUT_S * 1000000000LL) {
+            fprintf(stderr, "Only %d of %d clients logged in.\n", phases.ready.load(), opt.clients);
+            return 1;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::int64_t t_ready = now_ns();
+
+    std::int64_t start = now_ns();
+    phases.measure_start = start + static_cast<std::int64_t>(opt.warmup * 1e9);
+    phases.send_end = phases.measure_start + static_cast<std::int64_t>(opt.duration * 1e9);
+    phases.send_start.store(start);
+
+    for (std::thread& t : threads) t.join();
+
+    // 合并各线程的统计
+    WorkerStats total;
+    for (Worker* w : workers) {
+        WorkerStats& s = w->stats();
+        total.latency_us.insert(total.latency_us.end(), s.latency_us.begin(), s.latency_us.end());
+        total.sent += s.sent;
+        total.send_fail += s.send_fail;
+        total.delivered += s.delivered;
+    }
+    std::sort(total.latency_us.begin(), total.latency_us.end());
+
+    double connect_s = (t_connected - t0) / 1e9;
+    double setup_s = (t_ready - t0) / 1e9;
+    double conn_per_s = opt.clients / connect_s;
+    double login_per_s = opt.clients / setup_s;
+    double sent_per_s = total.sent / opt.duration;
+    double delivered_per_s = total.delivered / opt.duration;
+
+    fprintf(stderr,
+        "%d clients (%d senders, %d rooms): connect %.0f/s, login %.0f/s\n"
+        "sent %llu msgs (%.0f/s, %llu failed), delivered %llu (%.0f/s)\n"
+        "latency us: p50 %u  p99 %u  p999 %u  max %u\n",
+        opt.clients, opt.senders, opt.rooms, conn_per_s, login_per_s,
+        (unsigned long long)total.sent, sent_per_s, (unsigned long long)total.send_fail,
+        (unsigned long long)total.delivered, delivered_per_s,
+        percentile(total.latency_us, 0.5), percentile(total.latency_us, 0.99),
+        percentile(total.latency_us, 0.999),
+        total.latency_us.empty() ? 0 : total.latency_us.back());
+
+    FILE* out = stdout;
+    if (!opt.csv.empty()) {
+        out = fopen(opt.csv.c_str(), "a");
+        if (!out) {
+            fprintf(stderr, "Cannot open %s\n", opt.csv.c_str());
+            return 1;
+        }
+    }
+    fseek(out, 0, SEEK_END);
+    if (ftell(out) <= 0) {
+        fprintf(out, "label,clients,senders,rooms,codec,size,rate,duration_s,connect_per_s,login_per_s,"
+                     "sent,sent_per_s,send_fail,delivered,delivered_per_s,p50_us,p99_us,p999_us,max_us\n");
+    }
+    fprintf(out, "%s,%d,%d,%d,%s,%zu,%.0f,%.1f,%.0f,%.0f,%llu,%.0f,%llu,%llu,%.0f,%u,%u,%u,%u\n",
+        opt.label.c_str(), opt.clients, opt.senders, opt.rooms, opt.binary ? "binary" : "json",
+        opt.size, opt.rate, opt.duration, conn_per_s, login_per_s,
+        (unsigned long long)total.sent, sent_per_s, (unsigned long long)total.send_fail,
+        (unsigned long long)total.delivered, delivered_per_s,
+        percentile(total.latency_us, 0.5), percentile(total.latency_us, 0.99),
+        percentile(total.latency_us, 0.999),
+        total.latency_us.empty() ? 0 : total.latency_us.back());
+    if (out != stdout) fclose(out);
+
+    for (BenchClient* c : clients) {
+        close(c->fd);
+        delete c;
+    }
+    for (Worker* w : workers) delete w;
+    return 0;
+}
@@ -0,0 +1,159 @@
+// bench_parse.cpp -- Message 解析微基准：旧的 extract_value_robust 与 MessageView 对比，
+// 以及 JSON 与二进制编码的体积和编解码开销
+// g++ -std=c++17 -O2 -o bench_parse bench_parse.cpp Message.cpp
+// 用法：bench_parse [迭代次数]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "Message.h"
+
+using std::string;
+using std::vector;
+using clock_type = std::chrono::steady_clock;
+
+// 原实现：每个字段构造一次模式串、从头 find 一遍、再 substr 拷贝
+static string extract_value_robust(const string& json, const string& key) {
+    string pattern = "\"" + key + "\":\"";
+    size_t start_pos = json.find(pattern);
+    if (start_pos == string::npos) {
+        return "";
+    }
+
+    size_t value_start = start_pos + pattern.length();
+    if (value_start >= json.length()) {
+        return "";
+    }
+
+    size_t value_end = value_start;
+    bool in_escape = false;
+
+    for (; value_end < json.length(); ++value_end) {
+        char current_char = json[value_end];
+        if (in_escape) {
+            in_escape = false;
+        }
+        else if (current_char == '\\') {
+            in_escape = true;
+        }
+        else if (current_char == '\"') {
+            break;
+        }
+    }
+
+    if (value_end == json.length()) {
+        return "";
+    }
+
+    return json.substr(value_start, value_end - value_start);
+}
+
+struct LegacyMessage {
+    string type, user, msg, time;
+};
+
+static LegacyMessage legacy_from_json(const string& json) {
+    LegacyMessage m;
+    m.type = extract_value_robust(json, "type");
+    m.user = extract_value_robust(json, "user");
+    m.msg = extract_value_robust(json, "msg");
+    m.time = extract_value_robust(json, "time");
+    return m;
+}
+
+// 典型消息组合：短聊天占多数，夹杂长消息和带转义的消息
+static vector<string> make_corpus() {
+    vector<string> corpus;
+    const char* users[] = { "alice", "bob", "carol_the_longer_name", "d" };
+    for (int i = 0; i < 64; ++i) {
+        string text;
+        switch (i % 8) {
+        case 0: text = string(1500, 'x'); break;
+        case 1: text = "he said \"hi\" and left\n"; break;
+        case 2: text = string(200, 'y'); break;
+        default: text = "hello world #" + std::to_string(i); break;
+        }
+        Message m("chat", users[i % 4], text, "12:34:56");
+        corpus.push_back(m.toString());
+    }
+    return corpus;
+}
+
+template <class T, class F>
+static double run(const char* name, const vector<T>& corpus, long iters, F&& fn) {
+    size_t sink = 0;
+    auto t0 = clock_type::now();
+    for (long it = 0; it < iters; ++it) {
+        for (const T& item : corpus) sink += fn(item);
+    }
+    double ns = std::chrono::duration<double, std::nano>(clock_type::now() - t0).count();
+    double per_msg = ns / (double(iters) * corpus.size());
+    printf("%-28s %8.1f ns/msg  (checksum %zu)\n", name, per_msg, sink);
+    return per_msg;
+}
+
+int main(int argc, char* argv[]) {
+    long iters = argc > 1 ? atol(argv[1]) : 20000;
+    vector<string> corpus = make_corpus();
+
+    // 先确认两种解析结果一致（旧实现不解码转义，比较原始字段）
+    for (const string& json : corpus) {
+        LegacyMessage a = legacy_from_json(json);
+        MessageView v;
+        if (!v.parse(json) || a.type != v.type() || a.user != v.user() ||
+            a.msg != v.msg() || a.time != v.time()) {
+            fprintf(stderr, "mismatch: %s\n", json.c_str());
+            return 1;
+        }
+    }
+
+    printf("%zu messages x %ld iterations\n", corpus.size(), iters);
+    double legacy = run("legacy extract_value_robust", corpus, iters, [](const string& json) {
+        LegacyMessage m = legacy_from_json(json);
+        return m.msg.size() + m.user.size();
+    });
+    run("Message::from_json", corpus, iters, [](const string& json) {
+        Message m = Message::from_json(json);
+        return m.getMsg().size() + m.getUser().size();
+    });
+    double view = run("MessageView::parse", corpus, iters, [](const string& json) {
+        MessageView v;
+        v.parse(json);
+        return v.msg().size() + v.user().size();
+    });
+    printf("speedup (view vs legacy): %.1fx\n", legacy / view);
+
+    // 同一批消息分别编码为 JSON 帧和二进制帧
+    vector<Message> msgs;
+    vector<string> bin_corpus;
+    size_t json_bytes = 0, bin_bytes = 0;
+    for (const string& json : corpus) {
+        msgs.push_back(Message::from_json(json));
+        FrameRef j = msgs.back().toFrame();
+        FrameRef b = msgs.back().toBinaryFrame();
+        json_bytes += j->size();
+        bin_bytes += b->size();
+        bin_corpus.emplace_back(b->payload(), b->payload_size());
+        Message back = Message::decode(bin_corpus.back());
+        if (back.getType() != msgs.back().getType() || back.getUser() != msgs.back().getUser() ||
+            back.getMsg() != msgs.back().getMsg() || back.getTime() != msgs.back().getTime()) {
+            fprintf(stderr, "binary round trip mismatch: %s\n", json.c_str());
+            return 1;
+        }
+    }
+    printf("\nframe size: json %.1f B/msg, binary %.1f B/msg (%.0f%%)\n",
+           double(json_bytes) / corpus.size(), double(bin_bytes) / corpus.size(),
+           100.0 * bin_bytes / json_bytes);
+
+    run("encode json", msgs, iters, [](const Message& m) { return m.toFrame()->size(); });
+    run("encode binary", msgs, iters, [](const Message& m) { return m.toBinaryFrame()->size(); });
+    run("decode binary (view)", bin_corpus, iters, [](const string& payload) {
+        MessageView v;
+        v.parse(payload);
+        return v.msg().size() + v.user().size();
+    });
+    return 0;
+}
@@ -1,15 +1,22 @@
-#define WIN32_LEAN_AND_MEAN // 取消 Windows.h 中不必要的部分，提高编译速率，减小可执行文件大小
-#define _WINSOCK_DEPRECATED_NO_WARNINGS // 取消 Winsock 函数弃用警告
+// client.cpp -- 聊天客户端：交互模式，以及从标准输入或文件回放消息的脚本模式
+// Windows：g++ -std=c++17 -O2 -o client.exe client.cpp Message.cpp -lws2_32
+// Linux：  g++ -std=c++17 -O2 -o client client.cpp Message.cpp -pthread
 #define _CRT_SECURE_NO_WARNINGS // 取消 'localtime' 警告
 
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
 #include <string>
-#include <winsock2.h>  // 使用 Winsock2 库进行网络编程,必须放在windows.h前面，不然会报300个错，我也不知道为什么
-#include <windows.h> // 使用 Windows API 进行多线程处理
+#include <string_view>
+#include <thread>
 
-#pragma comment(lib, "ws2_32.lib") // 链接 Winsock2 库
-
-#include "message.h"
+#include "net_compat.h"
+#include "Message.h"
+#include "framing.h"
 
 using std::string;
 using std::cout;
@@ -19,137 +26,301 @@ using std::cerr;
 
 #define PORT 8080 // 定义端口号
 #define SERVER_IP "127.0.0.1" // 定义地址为本机
-#define BUFFER_SIZE 4096 // 定义缓冲区大小
+#define BUFFER_SIZE 65536 // 接收缓冲区大小，脚本模式下一次读取可能包含上百条消息
+#define SEND_BATCH_BYTES (64 * 1024) // 脚本模式下攒够这么多字节再发送一次
+#define DRAIN_IDLE_MS 500 // 脚本读完后，连续这么久没有收到数据就退出
 
 SOCKET client_sock;  // 客户端套接字
-string username;  
+string username;
+bool framed = true;  // 默认使用长度前缀分帧，--raw 时退回旧的裸 JSON 协议
+bool want_binary = true;  // 登录时请求二进制编码，--json 时只用 JSON
+bool script_mode = false;  // --script 时不交互，收到的消息原样写到 stdout
+std::atomic<bool> use_binary(false);  // 收到服务器确认后才切换到二进制
+std::atomic<bool> disconnected(false);
+std::atomic<long long> last_recv_ms(0);  // 最近一次收到数据的时间，脚本模式据此判断是否收完
+
+static long long now_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
-// 接收消息的线程，处理异步接收消息 
-DWORD WINAPI receive_thread(LPVOID lpParam) {
-    char buffer[BUFFER_SIZE];
-    while (1) {
-        int bytes = recv(client_sock, buffer, BUFFER_SIZE - 1, 0);  // 一个字节一个字节持续从socket接收数据存到buffer缓存中
-        if (bytes <= 0) {
-            // 返回值小于0表明接收错误或断开连接，设置输出文字颜色为红色
-            SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), FOREGROUND_RED | FOREGROUND_INTENSITY);
-            cout << "\r" << std::string(80, ' ') << "\r"; // 清除当前输入行防止消息覆盖
-            cout << "[SYSTEM] Server disconnected." << endl;
+// 控制台颜色只在 Windows 交互模式下设置
+static void set_color(int attr) {
+#ifdef _WIN32
+    SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), (WORD)attr);
+#else
+    (void)attr;
+#endif
+}
 
-            // 恢复默认颜色
-            SetConsoleTextAttribute(GetStdHandle(STD_OUTPUT_HANDLE), 7);
+#ifdef _WIN32
+#define COLOR_SYSTEM (FOREGROUND_GREEN | FOREGROUND_INTENSITY)  // 亮绿色
+#define COLOR_ERROR (FOREGROUND_RED | FOREGROUND_INTENSITY)     // 亮红色
+#else
+#define COLOR_SYSTEM 0
+#define COLOR_ERROR 0
+#endif
+#define COLOR_NORMAL 7  // 灰白色
+
+static bool send_all(const char* p, size_t len) {
+    while (len > 0) {
+        int n = send(client_sock, p, (int)len, 0);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
 
-            break;
-        }
-        buffer[bytes] = '\0';
+// 把一帧追加到发送缓冲：分帧模式连同长度头，旧协议只有 JSON
+void append_frame(string& out, const FrameRef& frame) {
+    if (framed) out.append(frame->data(), frame->size());
+    else out.append(frame->payload(), frame->payload_size());
+}
 
-        Message msg = Message::from_json(string(buffer));
+// 发送一条消息：只编码一次，分帧模式连同长度头发送，旧协议只发 JSON
+void send_message(const Message& msg) {
+    string out;
+    append_frame(out, msg.toFrame(use_binary ? Codec::Binary : Codec::Json));
+    send_all(out.data(), out.size());
+}
 
-        // 清除当前输入行
-        cout << "\r" << std::string(80, ' ') << "\r";
+// 一条消息的显示文本，不含换行
+static string format_message(const Message& msg) {
+    if (msg.getType() == "system") return "[SYSTEM] " + msg.getMsg();
+    if (msg.getType() == "error") return "[ERROR] " + msg.getMsg();
+    return "[" + msg.getUser() + "]: " + msg.getMsg();
+}
 
-        HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);  // 获取控制台句柄便于修改颜色
+// 显示一条收到的消息
+void show_message(const Message& msg) {
+    // 清除当前输入行
+    cout << "\r" << std::string(80, ' ') << "\r";
 
-        if (msg.getType() == "system") {
-            // 系统消息：亮绿色
-            SetConsoleTextAttribute(hConsole, FOREGROUND_GREEN | FOREGROUND_INTENSITY);
-            cout << "[SYSTEM] " << msg.getMsg() << endl;
-        }
-        else if (msg.getType() == "error") {
-            // 错误消息：亮红色
-            SetConsoleTextAttribute(hConsole, FOREGROUND_RED | FOREGROUND_INTENSITY);
-            cout << "[ERROR] " << msg.getMsg() << endl;
-        }
-        else {
-            // 普通消息：灰白色
-            SetConsoleTextAttribute(hConsole, 7);  
-            cout << "[" << msg.getUser() << "]: " << msg.getMsg() << endl;
+    if (msg.getType() == "system") set_color(COLOR_SYSTEM);
+    else if (msg.getType() == "error") set_color(COLOR_ERROR);
+    else set_color(COLOR_NORMAL);
+    cout << format_message(msg) << endl;
+
+    // 恢复默认颜色
+    set_color(COLOR_NORMAL);
+
+    // 重新显示输入提示
+    cout << "[" << username << "]: ";
+    cout.flush();
+}
+
+// 接收消息的线程，处理异步接收消息
+void receive_thread() {
+    char buffer[BUFFER_SIZE];
+    StreamDecoder decoder(framed ? WireMode::Framed : WireMode::Raw);
+    string text;  // 脚本模式下一次 recv 中所有消息的输出，整块写出
+    while (1) {
+        int bytes = recv(client_sock, buffer, BUFFER_SIZE, 0);  // 持续从socket接收数据存到buffer缓存中
+        if (bytes <= 0) break;  // 返回值小于等于0表明接收错误或断开连接
+        last_recv_ms = now_ms();
+        // 一次 recv 可能包含多条或半条消息，交给解码器逐条切出
+        text.clear();
+        bool ok = decoder.feed(buffer, bytes, [&text](std::string_view payload) {
+            Message msg = Message::decode(payload);
+            // 服务器确认二进制编码，之后发送的消息改用二进制
+            if (msg.getType() == "codec") {
+                use_binary = (msg.getMsg() == CODEC_BINARY);
+                return;
+            }
+            if (script_mode) text.append(format_message(msg)).append("\n");
+            else show_message(msg);
+        });
+        if (!text.empty()) {
+            fwrite(text.data(), 1, text.size(), stdout);
+            fflush(stdout);
         }
+        if (!ok) break;
+    }
 
-        // 恢复默认颜色
-        SetConsoleTextAttribute(hConsole, 7);
+    disconnected = true;
+    if (script_mode) return;  // 由主线程结束
 
-        // 重新显示输入提示
-        cout << "[" << username << "]: ";
-        cout.flush();
+    // 设置输出文字颜色为红色
+    set_color(COLOR_ERROR);
+    cout << "\r" << std::string(80, ' ') << "\r"; // 清除当前输入行防止消息覆盖
+    cout << "[SYSTEM] Server disconnected." << endl;
+    // 恢复默认颜色
+    set_color(COLOR_NORMAL);
+    std::_Exit(0);
+}
+
+// 把一行输入编码成帧：房间命令、抓包得到的 JSON 消息（原样转发，保留其中的用户名和时间）或普通聊天内容。
+// 返回 false 表示输入 quit 或 logout，应当退出
+static bool encode_line(const string& input, string& out) {
+    Codec codec = use_binary ? Codec::Binary : Codec::Json;
+    if (input == "quit") return false;
+    // 房间命令：/join 切换到指定房间，/part 回到默认房间
+    if (input.compare(0, 6, "/join ") == 0) {
+        append_frame(out, Message("join", username, input.substr(6), get_current_time()).toFrame(codec));
+    }
+    else if (input == "/part") {
+        append_frame(out, Message("part", username, "", get_current_time()).toFrame(codec));
+    }
+    else if (script_mode && input[0] == '{') {
+        MessageView view;
+        if (!view.parse(input)) {
+            cerr << "Skipping malformed message: " << input << endl;
+            return true;
+        }
+        if (view.type() == "logout") return false;
+        if (view.type() == "login") return true;  // 已经用 --user 登录过
+        append_frame(out, view.toFrame(codec));
     }
+    // 其他情况则发送到服务端
+    else {
+        append_frame(out, Message("chat", username, input, get_current_time()).toFrame(codec));
+    }
+    return true;
+}
 
-    ExitProcess(0);
+// 脚本模式：逐行读取，编码后攒成一批再 send，发送速度只受服务器接收速度限制；
+// 读完后等收到的消息停止一段时间再登出
+static int run_script(std::istream& in) {
+    string batch;
+    batch.reserve(SEND_BATCH_BYTES + BUFFER_SIZE);
+    string line;
+    unsigned long long lines = 0;
+    bool quit = false;
+    auto start = std::chrono::steady_clock::now();
+    while (!quit && !disconnected && std::getline(in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (line.empty()) continue;
+        quit = !encode_line(line, batch);
+        ++lines;
+        if (batch.size() >= SEND_BATCH_BYTES) {
+            if (!send_all(batch.data(), batch.size())) break;
+            batch.clear();
+        }
+    }
+    if (!batch.empty()) send_all(batch.data(), batch.size());
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    cerr << "Sent " << lines << " lines in " << secs << " s (" << (secs > 0 ? lines / secs : 0) << "/s)." << endl;
+
+    last_recv_ms = now_ms();
+    while (!disconnected && now_ms() - last_recv_ms < DRAIN_IDLE_MS) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (!disconnected) send_message(Message("logout", username, "", get_current_time()));
     return 0;
 }
 
+static void usage() {
+    cerr << "Usage: client [--host IP] [--port N] [--raw] [--json]\n"
+            "              [--script FILE|-] [--user NAME]" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    string host = SERVER_IP;
+    unsigned short port = PORT;
+    string script;
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--raw")) framed = false;
+        else if (!strcmp(argv[i], "--json")) want_binary = false;
+        else if (!strcmp(argv[i], "--host") && i + 1 < argc) host = argv[++i];
+        else if (!strcmp(argv[i], "--port") && i + 1 < argc) port = (unsigned short)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--script") && i + 1 < argc) script = argv[++i];
+        else if (!strcmp(argv[i], "--user") && i + 1 < argc) username = argv[++i];
+        else {
+            usage();
+            return 1;
+        }
+    }
+    script_mode = !script.empty();
+
+    std::ifstream script_file;
+    if (script_mode && script != "-") {
+        script_file.open(script, std::ios::binary);
+        if (!script_file) {
+            cerr << "Cannot open script: " << script << endl;
+            return 1;
+        }
+    }
 
-int main() {
-    WSADATA wsa;  // 初始化Winsock
-    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
+    if (!net_startup()) {  // 初始化Winsock
         cerr << "WSAStartup failed." << endl;
         return 1;
     }
 
-
     // 创建套接字
     client_sock = socket(AF_INET, SOCK_STREAM, 0); // IPV4,TCP
     if (client_sock == INVALID_SOCKET) {
         cerr << "Socket creation failed." << endl;
-        WSACleanup();
+        net_cleanup();
         return 1;
     }
 
     // 定义IPv4 地址结构体
-    sockaddr_in serv_addr;
+    sockaddr_in serv_addr{};
     serv_addr.sin_family = AF_INET;
-    serv_addr.sin_port = htons(PORT);
-    serv_addr.sin_addr.s_addr = inet_addr(SERVER_IP);
+    serv_addr.sin_port = htons(port);
+    if (inet_pton(AF_INET, host.c_str(), &serv_addr.sin_addr) != 1) {
+        cerr << "Invalid host: " << host << endl;
+        closesocket(client_sock);
+        net_cleanup();
+        return 1;
+    }
 
-    // 开始聊天客户端，注册用户昵称
-    cout << "=== Chat Client ===" << endl;
-    cout << "Enter username: ";
-    std::getline(cin, username);
+    // 开始聊天客户端，注册用户昵称；脚本模式不提示
+    if (!script_mode) {
+        cout << "=== Chat Client ===" << endl;
+        cout << "Enter username: ";
+        std::getline(cin, username);
+    }
+    else if (username.empty()) {
+        username = "replay";
+    }
 
     // 尝试连接到服务器
     if (connect(client_sock, (SOCKADDR*)&serv_addr, sizeof(serv_addr)) == SOCKET_ERROR) {
         cerr << "Connect failed. Please ensure the server is running." << endl;
-        closesocket(client_sock); 
-        WSACleanup();
+        closesocket(client_sock);
+        net_cleanup();
         return 1;
     }
 
     // 发送登录消息
     string time_str = get_current_time();
-    Message login_msg("login", username, "", time_str); // 创建登录消息对象
-    string login_data = login_msg.toString(); // 将消息转换为json格式的字符串
-    send(client_sock, login_data.c_str(), login_data.length(), 0); // 发送到服务端
-
-    cout << "Connected! Type 'quit' to exit." << endl;
+    // 分帧模式下在 msg 中声明支持二进制编码，旧协议只能用 JSON
+    string codec = (framed && want_binary) ? string(CODEC_BINARY) : "";
+    Message login_msg("login", username, codec, time_str); // 创建登录消息对象
+    send_message(login_msg); // 编码后发送到服务端
 
     // 启动接收消息的线程
-    HANDLE hThread = CreateThread(NULL, 0, receive_thread, NULL, 0, NULL);
-    if (!hThread) {
-        cerr << "Failed to create receiver thread." << endl;
+    std::thread receiver(receive_thread);
+
+    if (script_mode) {
+        int ret = run_script(script == "-" ? cin : script_file);
+        // 关闭两个方向，让还阻塞在 recv 上的接收线程退出
+        shutdown(client_sock, SHUT_RDWR);
+        receiver.join();
         closesocket(client_sock);
-        WSACleanup();
-        return 1;
+        net_cleanup();
+        return ret;
     }
-    CloseHandle(hThread); // 释放句柄，防止资源泄漏
+    receiver.detach();
+
+    cout << "Connected! Type 'quit' to exit, '/join <room>' to switch rooms, '/part' to return to the lobby." << endl;
 
     // 主循环发送消息
     cout << "[" << username << "]: "; // 显示当前用户昵称
     cout.flush();
 
-    while (1) {
-        string input;
-        std::getline(cin, input);
-
-        // 当输入为quit时，发送登出消息并退出
-        if (input == "quit") {
-            Message logout_msg("logout", username, "", get_current_time());
-            send(client_sock, logout_msg.toString().c_str(), logout_msg.toString().length(), 0);
-            break;
-        }
-
-        // 其他情况则发送到服务端
+    string input;
+    while (std::getline(cin, input)) {
         if (!input.empty()) {
-            Message chat_msg("chat", username, input, get_current_time());
-            send(client_sock, chat_msg.toString().c_str(), chat_msg.toString().length(), 0);
+            string out;
+            // 当输入为quit时，发送登出消息并退出
+            if (!encode_line(input, out)) {
+                send_message(Message("logout", username, "", get_current_time()));
+                break;
+            }
+            send_all(out.data(), out.size());
         }
 
         // 重新恢复状态等待下一条信息的发送
@@ -158,6 +329,6 @@ int main() {
     }
 
     closesocket(client_sock);
-    WSACleanup();
+    net_cleanup();
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,294 @@
+// federation.cpp -- 实例之间的链路、转发与防环
+#include "federation.h"
+#include "Message.h"
+#include "framing.h"
+#include "metrics.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+using std::string;
+using std::cerr;
+using std::endl;
+
+#define FED_FIXED_HEADER 18  // 跳数 1 + keep 1 + 序号 8 + 时间 8
+#define FED_RECV_BUFFER 65536
+
+static void put_u64(char* p, uint64_t v) {
+    for (int i = 7; i >= 0; --i) {
+        p[i] = static_cast<char>(v & 0xFF);
+        v >>= 8;
+    }
+}
+
+static uint64_t get_u64(const char* p) {
+    uint64_t v = 0;
+    for (int i = 0; i < 8; ++i) v = (v << 8) | static_cast<unsigned char>(p[i]);
+    return v;
+}
+
+static bool send_all(SOCKET s, const char* p, size_t len) {
+    while (len > 0) {
+        int n = send(s, p, (int)len, 0);
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 一条到其他实例的连接：读线程处理收到的消息，写线程批量发出队列中的帧
+struct Federation::Link {
+    SOCKET sock;
+    string name;
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::vector<FrameRef> queue;
+    size_t queued_bytes = 0;
+    bool closed = false;
+
+    void push(const FrameRef& f) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (closed) return;
+            if (queued_bytes + f->size() > FED_LINK_MAX_BYTES) {
+                metrics_add(FED_DROPPED);
+                return;
+            }
+            queue.push_back(f);
+            queued_bytes += f->size();
+        }
+        metrics_add(FED_OUT);
+        cv.notify_one();
+    }
+
+    void write_loop() {
+        std::vector<FrameRef> batch;
+        string buf;
+        while (1) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                cv.wait(lock, [this] { return closed || !queue.empty(); });
+                if (closed) return;
+                batch.swap(queue);
+                queued_bytes = 0;
+            }
+            // 等待期间积累的所有帧拼成一块，一次 send
+            buf.clear();
+            for (const FrameRef& f : batch) buf.append(f->data(), f->size());
+            batch.clear();
+            if (!send_all(sock, buf.data(), buf.size())) {
+                shutdown(sock, SHUT_RDWR);  // 让读线程退出并清理
+                return;
+            }
+        }
+    }
+};
+
+bool Federation::start(const FederationConfig& cfg, Deliver deliver) {
+    deliver_ = std::move(deliver);
+    // 实例 ID 带上启动时间：重启后序号从 0 开始，不能与上次的消息混淆
+    uint64_t boot = std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    id_ = (cfg.node_id.empty() ? "node" + std::to_string(cfg.port) : cfg.node_id) + "@" + std::to_string(boot);
+    if (id_.size() > 255) id_.resize(255);
+
+    if (cfg.port > 0) {
+        SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s == INVALID_SOCKET) {
+            cerr << "Federation socket creation failed." << endl;
+            return false;
+        }
+        int on = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(cfg.port);
+        if (bind(s, (SOCKADDR*)&addr, sizeof(addr)) == SOCKET_ERROR || listen(s, 16) == SOCKET_ERROR) {
+            cerr << "Federation port " << cfg.port << " bind failed." << endl;
+            closesocket(s);
+            return false;
+        }
+        std::thread([this, s] { accept_loop(s); }).detach();
+    }
+    for (const string& peer : cfg.peers) {
+        std::thread([this, peer] { dial_loop(peer); }).detach();
+    }
+    return true;
+}
+
+void Federation::accept_loop(SOCKET listener) {
+    while (1) {
+        sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        SOCKET s = accept(listener, (SOCKADDR*)&addr, &len);
+        if (s == INVALID_SOCKET) continue;
+        char ip[INET_ADDRSTRLEN] = "?";
+        inet_ntop(AF_INET, &addr.sin_addr, ip, sizeof(ip));
+        string name = string(ip) + ":" + std::to_string(ntohs(addr.sin_port));
+        std::thread([this, s, name] { run_link(s, name); }).detach();
+    }
+}
+
+// 主动连接一个实例，断开或连不上时每秒重试
+void Federation::dial_loop(string peer) {
+    size_t colon = peer.rfind(':');
+    string host = colon == string::npos ? "127.0.0.1" : peer.substr(0, colon);
+    if (host == "localhost") host = "127.0.0.1";
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)atoi(peer.c_str() + (colon == string::npos ? 0 : colon + 1)));
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+        cerr << "Invalid peer address: " << peer << endl;
+        return;
+    }
+    while (1) {
+        SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s != INVALID_SOCKET && connect(s, (SOCKADDR*)&addr, sizeof(addr)) != SOCKET_ERROR) {
+            run_link(s, peer);
+        } else if (s != INVALID_SOCKET) {
+            closesocket(s);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+}
+
+void Federation::run_link(SOCKET sock, const string& name) {
+    int on = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (const char*)&on, sizeof(on));
+    auto link = std::make_shared<Link>();
+    link->sock = sock;
+    link->name = name;
+    {
+        std::lock_guard<std::mutex> lock(links_mutex_);
+        links_.push_back(link);
+    }
+    cerr << "Federation link up: " << name << endl;
+    std::thread writer([link] { link->write_loop(); });
+
+    char buf[FED_RECV_BUFFER];
+    StreamDecoder decoder(WireMode::Framed);
+    while (1) {
+        int n = recv(sock, buf, sizeof(buf), 0);
+        if (n <= 0) break;
+        if (!decoder.feed(buf, n, [&](std::string_view payload) { on_frame(link.get(), payload); })) break;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(links_mutex_);
+        for (size_t i = 0; i < links_.size(); ++i) {
+            if (links_[i] == link) {
+                links_[i] = links_.back();
+                links_.pop_back();
+                break;
+            }
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(link->mutex);
+        link->closed = true;
+        link->queue.clear();
+    }
+    link->cv.notify_one();
+    writer.join();
+    closesocket(sock);
+    cerr << "Federation link down: " << name << endl;
+}
+
+void Federation::publish(const string& room, const FrameRef& json, bool keep) {
+    {
+        std::lock_guard<std::mutex> lock(links_mutex_);
+        if (links_.empty()) return;
+    }
+    size_t room_len = std::min<size_t>(room.size(), 255);
+    size_t head = FED_FIXED_HEADER + 1 + id_.size() + 1 + room_len;
+    char* out;
+    FrameRef frame = Frame::alloc(FRAME_HEADER_LEN + head + json->payload_size(), &out, FRAME_HEADER_LEN);
+    put_frame_header(out, static_cast<uint32_t>(head + json->payload_size()));
+    char* p = out + FRAME_HEADER_LEN;
+    p[0] = 0;  // 跳数
+    p[1] = keep ? 1 : 0;
+    put_u64(p + 2, ++seq_);
+    put_u64(p + 10, metrics_now_ns());
+    p += FED_FIXED_HEADER;
+    *p++ = static_cast<char>(id_.size());
+    memcpy(p, id_.data(), id_.size());
+    p += id_.size();
+    *p++ = static_cast<char>(room_len);
+    memcpy(p, room.data(), room_len);
+    p += room_len;
+    memcpy(p, json->payload(), json->payload_size());
+    forward(frame, nullptr);
+}
+
+void Federation::forward(const FrameRef& frame, const Link* except) {
+    std::lock_guard<std::mutex> lock(links_mutex_);
+    for (const auto& link : links_) {
+        if (link.get() != except) link->push(frame);
+    }
+}
+
+// 滑动窗口去重：比窗口还旧的序号也当作重复
+bool Federation::first_seen(const string& origin, uint64_t seq) {
+    std::lock_guard<std::mutex> lock(seen_mutex_);
+    Window& w = seen_[origin];
+    if (seq > w.max) {
+        uint64_t shift = seq - w.max;
+        w.bits = shift >= 64 ? 0 : w.bits << shift;
+        w.bits |= 1;
+        w.max = seq;
+        return true;
+    }
+    uint64_t age = w.max - seq;
+    if (age >= 64) return false;
+    uint64_t bit = 1ull << age;
+    if (w.bits & bit) return false;
+    w.bits |= bit;
+    return true;
+}
+
+void Federation::on_frame(Link* from, std::string_view payload) {
+    const char* p = payload.data();
+    size_t len = payload.size();
+    if (len < FED_FIXED_HEADER + 2) return;
+    size_t id_len = static_cast<unsigned char>(p[FED_FIXED_HEADER]);
+    size_t room_off = FED_FIXED_HEADER + 1 + id_len;
+    if (room_off + 1 > len) return;
+    size_t room_len = static_cast<unsigned char>(p[room_off]);
+    size_t json_off = room_off + 1 + room_len;
+    if (json_off > len) return;
+
+    unsigned hops = static_cast<unsigned char>(p[0]);
+    bool keep = p[1] != 0;
+    uint64_t seq = get_u64(p + 2);
+    uint64_t sent_ns = get_u64(p + 10);
+    string origin(p + FED_FIXED_HEADER + 1, id_len);
+    if (origin == id_ || !first_seen(origin, seq)) {
+        metrics_add(FED_DUP);
+        return;
+    }
+    metrics_add(FED_IN);
+    uint64_t now = metrics_now_ns();
+    if (now > sent_ns) metrics_record(HIST_FED_HOP_NS, now - sent_ns);
+
+    // 转发给其他实例：只改跳数，其余原样
+    if (hops + 1 < FED_MAX_HOPS) {
+        char* out;
+        FrameRef fwd = Frame::alloc(FRAME_HEADER_LEN + len, &out, FRAME_HEADER_LEN);
+        put_frame_header(out, static_cast<uint32_t>(len));
+        memcpy(out + FRAME_HEADER_LEN, p, len);
+        out[FRAME_HEADER_LEN] = static_cast<char>(hops + 1);
+        forward(fwd, from);
+    }
+
+    string room(p + room_off + 1, room_len);
+    std::string_view json(p + json_off, len - json_off);
+    MessageView view;
+    view.parse(json);
+    deliver_(room, make_frame(json), view.toBinaryFrame(), keep);
+}
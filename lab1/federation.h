@@ -0,0 +1,75 @@
+#pragma once
+
+// federation.h -- 多个服务器实例之间转发广播
+// 每个实例在 --fed-port 上接受其他实例的连接，并主动连接 --peer 列出的实例，连接断开后每秒重连。
+// 一条连接双向使用，所以两个实例之间只需要一方写 --peer。
+// 本地产生的房间广播（chat 和 system）发给所有链路；收到的消息在本地投递，再转给除来源外的其他链路，
+// 因此不是全连接的拓扑（例如 A-B-C 一条链）也能送达每个实例。
+// 防环：每条消息带来源实例 ID 和该实例内递增的序号，每个来源维护一个 64 位滑动窗口，重复的直接丢弃；
+// 另外经过 FED_MAX_HOPS 跳后不再转发。实例 ID 含启动时间，重启后序号从头开始也不会被误判为重复。
+// 每条链路有自己的发送队列和写线程，写线程把积累的消息拼成一块一次 send 写出。
+//
+// 链路上的帧：4 字节大端长度 + 正文
+//   u8 跳数 | u8 keep | u64 序号 | u64 源实例发出时的单调时钟（纳秒） | u8 ID 长度 | ID | u8 房间名长度 | 房间名 | JSON
+// 单调时钟只在同一台机器上可比，用来统计本机多实例之间的转发延迟
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "net_compat.h"
+#include "frame.h"
+
+#define FED_MAX_HOPS 8
+#define FED_LINK_MAX_BYTES (4u << 20)  // 链路发送队列上限，对端过慢或断开时丢弃新消息
+
+struct FederationConfig {
+    std::string node_id;              // 为空时用监听端口生成
+    unsigned short port = 0;          // 接受其他实例连接的端口，0 表示不监听
+    std::vector<std::string> peers;   // 主动连接的实例，host:port
+};
+
+class Federation {
+public:
+    // 收到其他实例的消息时调用（在链路线程上），两种编码都已编好
+    using Deliver = std::function<void(const std::string& room, FrameRef json, FrameRef binary, bool keep)>;
+
+    Federation() = default;
+    Federation(const Federation&) = delete;
+    Federation& operator=(const Federation&) = delete;
+
+    bool start(const FederationConfig& cfg, Deliver deliver);
+
+    // 任意线程调用：把本地产生的房间广播发给所有链路
+    void publish(const std::string& room, const FrameRef& json, bool keep);
+
+private:
+    struct Link;
+    struct Window {
+        std::uint64_t max = 0;   // 见过的最大序号
+        std::uint64_t bits = 0;  // 第 i 位表示 max - i 已见过
+    };
+
+    void accept_loop(SOCKET listener);
+    void dial_loop(std::string peer);
+    void run_link(SOCKET sock, const std::string& name);
+    void on_frame(Link* from, std::string_view payload);
+    bool first_seen(const std::string& origin, std::uint64_t seq);
+    void forward(const FrameRef& frame, const Link* except);
+
+    std::string id_;
+    Deliver deliver_;
+    std::atomic<std::uint64_t> seq_{ 0 };
+
+    std::mutex links_mutex_;
+    std::vector<std::shared_ptr<Link>> links_;
+
+    std::mutex seen_mutex_;
+    std::unordered_map<std::string, Window> seen_;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+// frame.h -- 不可变、带引用计数的已编码消息帧
+// 一条入站消息只编码一次，广播时每个接收者的发送队列只持有一个 FrameRef，
+// 复制 FrameRef 只是原子加一，不会再分配内存或拷贝消息内容。
+// 帧可以带一段前缀（如长度头），不同协议的连接各取所需的部分发送
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <utility>
+
+class FrameRef;
+
+class Frame {
+public:
+    // 完整内容（含前缀）
+    const char* data() const { return reinterpret_cast<const char*>(this + 1); }
+    size_t size() const { return size_; }
+
+    // 去掉前缀后的正文
+    const char* payload() const { return data() + prefix_; }
+    size_t payload_size() const { return size_ - prefix_; }
+    size_t prefix() const { return prefix_; }
+
+    // 分配一个 len 字节的帧，内容由调用方通过 writable 指针一次性填好，
+    // 前 prefix 字节为前缀
+    static FrameRef alloc(size_t len, char** writable, size_t prefix = 0);
+    static FrameRef copy(const char* data, size_t len, size_t prefix = 0);
+
+private:
+    friend class FrameRef;
+    Frame(size_t len, size_t prefix)
+        : refs_(1), prefix_(static_cast<std::uint32_t>(prefix)), size_(len) {}
+
+    void retain() { refs_.fetch_add(1, std::memory_order_relaxed); }
+    void release() {
+        if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            this->~Frame();
+            std::free(this);
+        }
+    }
+
+    // 计数为原子量，帧可以安全地交给其他线程的发送队列
+    std::atomic<std::uint32_t> refs_;
+    std::uint32_t prefix_;
+    size_t size_;
+    // 帧内容紧跟在对象之后，头和数据只需一次 malloc
+};
+
+class FrameRef {
+public:
+    FrameRef() = default;
+    FrameRef(const FrameRef& o) : f_(o.f_) { if (f_) f_->retain(); }
+    FrameRef(FrameRef&& o) noexcept : f_(o.f_) { o.f_ = nullptr; }
+    FrameRef& operator=(FrameRef o) noexcept { std::swap(f_, o.f_); return *this; }
+    ~FrameRef() { if (f_) f_->release(); }
+
+    const Frame* operator->() const { return f_; }
+    const Frame& operator*() const { return *f_; }
+    explicit operator bool() const { return f_ != nullptr; }
+
+private:
+    friend class Frame;
+    explicit FrameRef(Frame* f) : f_(f) {}
+    Frame* f_ = nullptr;
+};
+
+inline FrameRef Frame::alloc(size_t len, char** writable, size_t prefix) {
+    void* mem = std::malloc(sizeof(Frame) + len);
+    if (!mem) throw std::bad_alloc();
+    Frame* f = new (mem) Frame(len, prefix);
+    *writable = reinterpret_cast<char*>(f + 1);
+    return FrameRef(f);
+}
+
+inline FrameRef Frame::copy(const char* data, size_t len, size_t prefix) {
+    char* p;
+    FrameRef ref = alloc(len, &p, prefix);
+    std::memcpy(p, data, len);
+    return ref;
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+// framing.h -- 聊天协议的分帧与流式解码
+// 帧格式：4 字节大端长度 + 正文（JSON 或协商后的二进制编码，见 Message.h）。TCP 是字节流，一次 recv 可能包含多条消息
+// 或半条消息，StreamDecoder 负责从连续到达的数据中切出完整消息。
+// 旧客户端直接发送裸 JSON，服务器根据连接上的第一个字节自动识别：
+// 长度头的首字节必为 0（单帧不超过 MAX_FRAME_LEN），裸 JSON 以 '{' 开头
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+#include "frame.h"
+
+#define FRAME_HEADER_LEN 4
+#define MAX_FRAME_LEN (1u << 20)
+
+enum class WireMode : std::uint8_t {
+    Unknown,  // 尚未收到数据，由第一个字节决定
+    Raw,      // 旧协议：裸 JSON 对象首尾相接
+    Framed    // 长度前缀帧
+};
+
+inline void put_frame_header(char* p, std::uint32_t len) {
+    p[0] = static_cast<char>((len >> 24) & 0xFF);
+    p[1] = static_cast<char>((len >> 16) & 0xFF);
+    p[2] = static_cast<char>((len >> 8) & 0xFF);
+    p[3] = static_cast<char>(len & 0xFF);
+}
+
+inline std::uint32_t get_frame_header(const char* p) {
+    const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+    return (std::uint32_t(u[0]) << 24) | (std::uint32_t(u[1]) << 16) |
+           (std::uint32_t(u[2]) << 8) | std::uint32_t(u[3]);
+}
+
+// 给已编码的正文加上长度头，拷贝成一个共享帧
+inline FrameRef make_frame(std::string_view payload) {
+    char* out;
+    FrameRef frame = Frame::alloc(FRAME_HEADER_LEN + payload.size(), &out, FRAME_HEADER_LEN);
+    put_frame_header(out, static_cast<std::uint32_t>(payload.size()));
+    std::memcpy(out + FRAME_HEADER_LEN, payload.data(), payload.size());
+    return frame;
+}
+
+class StreamDecoder {
+public:
+    explicit StreamDecoder(WireMode mode = WireMode::Unknown) : mode_(mode) {}
+
+    WireMode mode() const { return mode_; }
+    bool failed() const { return failed_; }
+
+    // 处理新到达的一段数据，每切出一条完整消息就调用一次 on_msg(std::string_view)。
+    // 完整落在 data 内的消息直接引用 data，不做拷贝；只有跨越两次 recv 的半条消息
+    // 才会暂存到内部缓冲区。返回 false 表示协议错误（帧过长），应断开连接
+    template <class F>
+    bool feed(const char* data, size_t len, F&& on_msg);
+
+private:
+    template <class F>
+    const char* finish_partial(const char* p, const char* end, F& on_msg);
+    const char* scan_json(const char* p, const char* end);
+
+    WireMode mode_;
+    bool failed_ = false;
+    std::string partial_;  // 跨 recv 的半条消息
+
+    // 裸 JSON 模式的扫描状态，跨 feed 保留，避免重复扫描
+    int depth_ = 0;
+    bool in_str_ = false;
+    bool esc_ = false;
+};
+
+// 从 p 继续扫描当前 JSON 对象，返回对象结束后的位置；数据不够时返回 nullptr
+inline const char* StreamDecoder::scan_json(const char* p, const char* end) {
+    for (; p < end; ++p) {
+        char c = *p;
+        if (in_str_) {
+            if (esc_) esc_ = false;
+            else if (c == '\\') esc_ = true;
+            else if (c == '"') in_str_ = false;
+        }
+        else if (c == '"') in_str_ = true;
+        else if (c == '{') ++depth_;
+        else if (c == '}' && --depth_ == 0) return p + 1;
+    }
+    return nullptr;
+}
+
+// 先补全上一次剩下的半条消息，返回消耗到的位置；仍不完整时返回 nullptr
+template <class F>
+const char* StreamDecoder::finish_partial(const char* p, const char* end, F& on_msg) {
+    if (mode_ == WireMode::Framed) {
+        if (partial_.size() < FRAME_HEADER_LEN) {
+            size_t take = FRAME_HEADER_LEN - partial_.size();
+            if (take > size_t(end - p)) take = end - p;
+            partial_.append(p, take);
+            p += take;
+            if (partial_.size() < FRAME_HEADER_LEN) return nullptr;
+        }
+        std::uint32_t body = get_frame_header(partial_.data());
+        if (body > MAX_FRAME_LEN) {
+            failed_ = true;
+            return nullptr;
+        }
+        size_t take = FRAME_HEADER_LEN + body - partial_.size();
+        if (take > size_t(end - p)) take = end - p;
+        partial_.append(p, take);
+        p += take;
+        if (partial_.size() < FRAME_HEADER_LEN + body) return nullptr;
+        on_msg(std::string_view(partial_.data() + FRAME_HEADER_LEN, body));
+    }
+    else {
+        const char* q = scan_json(p, end);
+        partial_.append(p, q ? q : end);
+        if (!q) {
+            if (partial_.size() > MAX_FRAME_LEN) failed_ = true;
+            return nullptr;
+        }
+        p = q;
+        on_msg(std::string_view(partial_));
+    }
+    partial_.clear();
+    return p;
+}
+
+template <class F>
+bool StreamDecoder::feed(const char* data, size_t len, F&& on_msg) {
+    const char* p = data;
+    const char* end = data + len;
+    if (failed_) return false;
+    if (p == end) return true;
+    if (mode_ == WireMode::Unknown) {
+        mode_ = (*p == 0) ? WireMode::Framed : WireMode::Raw;
+    }
+
+    if (!partial_.empty()) {
+        p = finish_partial(p, end, on_msg);
+        if (!p) return !failed_;
+    }
+
+    // 快速路径：完整的消息直接从 data 中切出
+    while (p < end) {
+        if (mode_ == WireMode::Framed) {
+            if (size_t(end - p) < FRAME_HEADER_LEN) break;
+            std::uint32_t body = get_frame_header(p);
+            if (body > MAX_FRAME_LEN) {
+                failed_ = true;
+                return false;
+            }
+            if (size_t(end - p) < FRAME_HEADER_LEN + body) break;
+            on_msg(std::string_view(p + FRAME_HEADER_LEN, body));
+            p += FRAME_HEADER_LEN + body;
+        }
+        else {
+            // 跳过对象之间的空白或杂散字节
+            while (p < end && *p != '{') ++p;
+            if (p == end) break;
+            const char* q = scan_json(p, end);
+            if (!q) break;
+            on_msg(std::string_view(p, q - p));
+            p = q;
+        }
+    }
+
+    // 剩下的半条消息留到下一次 feed
+    partial_.assign(p, end);
+    if (partial_.size() > FRAME_HEADER_LEN + MAX_FRAME_LEN) {
+        failed_ = true;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+// history.h -- 每个房间最近 N 条聊天消息的环形缓冲区
+// 保存的是已编码的共享帧，入环只是复制 FrameRef，新客户端进入房间时把这些帧一次性放进它的发送队列。
+// 二进制编码的帧在第一次有二进制客户端需要时才生成
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "Message.h"
+
+class HistoryEntry {
+public:
+    HistoryEntry() = default;
+    explicit HistoryEntry(FrameRef json) : json_(std::move(json)) {}
+
+    const FrameRef& get(Codec codec) {
+        if (codec == Codec::Json) return json_;
+        if (!binary_) {
+            MessageView view;
+            view.parse(std::string_view(json_->payload(), json_->payload_size()));
+            binary_ = view.toBinaryFrame();
+        }
+        return binary_;
+    }
+
+private:
+    FrameRef json_;
+    FrameRef binary_;
+};
+
+// 不加锁，由调用方保证同一时间只有一个线程访问
+class RoomHistory {
+public:
+    explicit RoomHistory(size_t capacity) : capacity_(capacity) {}
+
+    size_t capacity() const { return capacity_; }
+
+    // 记录一条 JSON 帧，房间已满时覆盖最旧的一条
+    void add(const std::string& room, FrameRef json) {
+        if (capacity_ == 0) return;
+        Ring& r = rooms_[room];
+        if (r.entries.size() < capacity_) {
+            r.entries.emplace_back(std::move(json));
+            return;
+        }
+        r.entries[r.head] = HistoryEntry(std::move(json));
+        r.head = (r.head + 1) % capacity_;
+    }
+
+    // 从旧到新依次调用 f(HistoryEntry&)
+    template <class F>
+    void for_each(const std::string& room, F&& f) {
+        auto it = rooms_.find(room);
+        if (it == rooms_.end()) return;
+        Ring& r = it->second;
+        for (size_t i = 0; i < r.entries.size(); ++i) {
+            f(r.entries[(r.head + i) % r.entries.size()]);
+        }
+    }
+
+private:
+    struct Ring {
+        std::vector<HistoryEntry> entries;
+        size_t head = 0;  // 最旧一条的位置（环满之后才会移动）
+    };
+
+    size_t capacity_;
+    std::unordered_map<std::string, Ring> rooms_;
+};
@@ -0,0 +1,177 @@
+// metrics.cpp -- 计数器槽位登记、汇总与统计输出
+#include "metrics.h"
+#include "net_compat.h"
+
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::string;
+
+namespace {
+
+std::mutex slots_mutex;
+std::vector<MetricSlot*> all_slots;   // 从不释放，读取时遍历
+std::vector<MetricSlot*> free_slots;  // 所属线程已退出，可以交给新线程
+const std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+
+// 线程退出时把槽位放回空闲列表，已经累计的数值保留
+struct SlotOwner {
+    MetricSlot* slot = nullptr;
+    ~SlotOwner() {
+        if (!slot) return;
+        std::lock_guard<std::mutex> lock(slots_mutex);
+        free_slots.push_back(slot);
+    }
+};
+
+const char* const counter_names[COUNTER_COUNT] = {
+    "conn_opened", "conn_closed", "msg_in", "msg_out", "bytes_out", "broadcasts",
+    "fed_out", "fed_in", "fed_dup", "fed_dropped"
+};
+
+const char* const histogram_names[HISTOGRAM_COUNT] = {
+    "parse_ns", "fanout_ns", "queue_depth", "fed_hop_ns"
+};
+
+// 达到 p 分位的桶的上界
+uint64_t bucket_percentile(const uint64_t* buckets, uint64_t count, double p) {
+    uint64_t need = static_cast<uint64_t>(count * p);
+    if (need == 0) need = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < METRIC_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= need) return i == 0 ? 0 : (i >= 63 ? UINT64_MAX : (1ull << i) - 1);
+    }
+    return 0;
+}
+
+} // namespace
+
+MetricSlot* metrics_register_thread() {
+    static thread_local SlotOwner owner;
+    std::lock_guard<std::mutex> lock(slots_mutex);
+    if (!free_slots.empty()) {
+        owner.slot = free_slots.back();
+        free_slots.pop_back();
+        return owner.slot;
+    }
+    MetricSlot* s = new MetricSlot;
+    for (auto& c : s->counters) c.store(0, std::memory_order_relaxed);
+    for (auto& h : s->buckets) {
+        for (auto& b : h) b.store(0, std::memory_order_relaxed);
+    }
+    for (auto& v : s->sums) v.store(0, std::memory_order_relaxed);
+    all_slots.push_back(s);
+    owner.slot = s;
+    return s;
+}
+
+MetricSnapshot metrics_snapshot() {
+    MetricSnapshot snap;
+    snap.when = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(slots_mutex);
+    for (MetricSlot* s : all_slots) {
+        for (int c = 0; c < COUNTER_COUNT; ++c) {
+            snap.counters[c] += s->counters[c].load(std::memory_order_relaxed);
+        }
+        for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+            for (int b = 0; b < METRIC_BUCKETS; ++b) {
+                snap.buckets[h][b] += s->buckets[h][b].load(std::memory_order_relaxed);
+            }
+            snap.sums[h] += s->sums[h].load(std::memory_order_relaxed);
+        }
+    }
+    return snap;
+}
+
+string metrics_format(const MetricSnapshot& now, const MetricSnapshot* prev) {
+    auto since = prev ? prev->when : start_time;
+    double secs = std::chrono::duration<double>(now.when - since).count();
+    if (secs <= 0) secs = 1;
+
+    char line[256];
+    string out;
+    uint64_t open = now.counters[CONN_OPENED] - now.counters[CONN_CLOSED];
+    snprintf(line, sizeof(line), "%-12s %llu\n", "connections", (unsigned long long)open);
+    out += line;
+    for (int c = 0; c < COUNTER_COUNT; ++c) {
+        uint64_t delta = now.counters[c] - (prev ? prev->counters[c] : 0);
+        snprintf(line, sizeof(line), "%-12s %llu (%.0f/s)\n", counter_names[c],
+                 (unsigned long long)now.counters[c], delta / secs);
+        out += line;
+    }
+    // 直方图只统计这段时间内的记录
+    for (int h = 0; h < HISTOGRAM_COUNT; ++h) {
+        uint64_t buckets[METRIC_BUCKETS];
+        uint64_t count = 0;
+        for (int b = 0; b < METRIC_BUCKETS; ++b) {
+            buckets[b] = now.buckets[h][b] - (prev ? prev->buckets[h][b] : 0);
+            count += buckets[b];
+        }
+        uint64_t sum = now.sums[h] - (prev ? prev->sums[h] : 0);
+        if (count == 0) {
+            snprintf(line, sizeof(line), "%-12s -\n", histogram_names[h]);
+        } else {
+            snprintf(line, sizeof(line), "%-12s n %llu avg %.0f p50<=%llu p99<=%llu max<=%llu\n",
+                     histogram_names[h], (unsigned long long)count, (double)sum / count,
+                     (unsigned long long)bucket_percentile(buckets, count, 0.5),
+                     (unsigned long long)bucket_percentile(buckets, count, 0.99),
+                     (unsigned long long)bucket_percentile(buckets, count, 1.0));
+        }
+        out += line;
+    }
+    return out;
+}
+
+static void run_periodic(unsigned interval_s) {
+    MetricSnapshot prev = metrics_snapshot();
+    while (1) {
+        std::this_thread::sleep_for(std::chrono::seconds(interval_s));
+        MetricSnapshot now = metrics_snapshot();
+        std::cerr << "--- stats ---\n" << metrics_format(now, &prev) << std::flush;
+        prev = now;
+    }
+}
+
+// 每次查询报告累计值和相对上一次查询的速率
+static void run_admin(SOCKET listener) {
+    MetricSnapshot prev;
+    bool first = true;
+    while (1) {
+        SOCKET c = accept(listener, nullptr, nullptr);
+        if (c == INVALID_SOCKET) continue;
+        MetricSnapshot now = metrics_snapshot();
+        string text = metrics_format(now, first ? nullptr : &prev);
+        send(c, text.data(), (int)text.size(), 0);
+        closesocket(c);
+        prev = now;
+        first = false;
+    }
+}
+
+bool metrics_start_reporting(unsigned interval_s, unsigned short admin_port) {
+    if (admin_port > 0) {
+        SOCKET s = socket(AF_INET, SOCK_STREAM, 0);
+        if (s == INVALID_SOCKET) {
+            std::cerr << "Admin socket creation failed." << std::endl;
+            return false;
+        }
+        int on = 1;
+        setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&on, sizeof(on));
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);  // 只允许本机查询
+        addr.sin_port = htons(admin_port);
+        if (bind(s, (SOCKADDR*)&addr, sizeof(addr)) == SOCKET_ERROR || listen(s, 16) == SOCKET_ERROR) {
+            std::cerr << "Admin port " << admin_port << " bind failed." << std::endl;
+            closesocket(s);
+            return false;
+        }
+        std::thread(run_admin, s).detach();
+    }
+    if (interval_s > 0) std::thread(run_periodic, interval_s).detach();
+    return true;
+}
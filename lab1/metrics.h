@@ -0,0 +1,103 @@
+#pragma once
+
+// metrics.h -- 服务器热路径上的计数器与直方图
+// 每个线程写自己的槽位（单写者，不用加锁也不用原子加），读取时把所有槽位加起来。
+// 线程退出后槽位留给之后的新线程复用，数值继续累加，线程模式下每个连接一个线程也不会无限增长。
+// 直方图按 2 的幂分桶，只能给出数量级上的分位数，但记录一次只是几条指令
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+enum MetricCounter {
+    CONN_OPENED,
+    CONN_CLOSED,
+    MSG_IN,       // 收到的消息条数
+    MSG_OUT,      // 放进发送队列（或直接发出）的消息条数
+    BYTES_OUT,
+    BROADCASTS,
+    FED_OUT,      // 放进实例间链路发送队列的消息
+    FED_IN,       // 从其他实例收到并投递的消息
+    FED_DUP,      // 重复或绕回自己的消息，已丢弃
+    FED_DROPPED,  // 链路队列满而丢弃
+    COUNTER_COUNT
+};
+
+enum MetricHistogram {
+    HIST_PARSE_NS,    // 单条消息的解析耗时
+    HIST_FANOUT_NS,   // 一次广播分发给房间成员的耗时
+    HIST_QUEUE_DEPTH, // 写出前客户端发送队列中的消息数（仅 epoll/uring 模式）
+    HIST_FED_HOP_NS,  // 消息从源实例发出到本实例收到的时间（仅同一台机器上有意义）
+    HISTOGRAM_COUNT
+};
+
+#define METRIC_BUCKETS 64  // 第 i 个桶记录 [2^(i-1), 2^i) 的值，0 在第 0 个桶
+
+struct alignas(64) MetricSlot {
+    std::atomic<uint64_t> counters[COUNTER_COUNT];
+    std::atomic<uint64_t> buckets[HISTOGRAM_COUNT][METRIC_BUCKETS];
+    std::atomic<uint64_t> sums[HISTOGRAM_COUNT];
+};
+
+// 所有槽位之和
+struct MetricSnapshot {
+    uint64_t counters[COUNTER_COUNT] = {};
+    uint64_t buckets[HISTOGRAM_COUNT][METRIC_BUCKETS] = {};
+    uint64_t sums[HISTOGRAM_COUNT] = {};
+    std::chrono::steady_clock::time_point when;
+};
+
+// 第一次使用时为当前线程分配（或复用）一个槽位
+MetricSlot* metrics_register_thread();
+
+inline MetricSlot& metrics_slot() {
+    static thread_local MetricSlot* slot = nullptr;
+    if (!slot) slot = metrics_register_thread();
+    return *slot;
+}
+
+// 只有所属线程写，读写各自原子即可，不需要 lock 前缀的原子加
+inline void metrics_bump(std::atomic<uint64_t>& a, uint64_t n) {
+    a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+inline void metrics_add(MetricCounter c, uint64_t n = 1) {
+    metrics_bump(metrics_slot().counters[c], n);
+}
+
+inline void metrics_record(MetricHistogram h, uint64_t value) {
+    int bucket = value == 0 ? 0 : 64 - __builtin_clzll(value);
+    if (bucket >= METRIC_BUCKETS) bucket = METRIC_BUCKETS - 1;
+    MetricSlot& s = metrics_slot();
+    metrics_bump(s.buckets[h][bucket], 1);
+    metrics_bump(s.sums[h], value);
+}
+
+inline uint64_t metrics_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 作用域结束时把耗时记入直方图
+class MetricTimer {
+public:
+    explicit MetricTimer(MetricHistogram h) : h_(h), start_(metrics_now_ns()) {}
+    ~MetricTimer() { metrics_record(h_, metrics_now_ns() - start_); }
+
+    MetricTimer(const MetricTimer&) = delete;
+    MetricTimer& operator=(const MetricTimer&) = delete;
+
+private:
+    MetricHistogram h_;
+    uint64_t start_;
+};
+
+MetricSnapshot metrics_snapshot();
+
+// 文本报告：累计值，以及相对 prev 的每秒速率（prev 为空时相对进程启动）
+std::string metrics_format(const MetricSnapshot& now, const MetricSnapshot* prev);
+
+// 启动统计输出：interval_s > 0 时每隔这么多秒向 stderr 打印一次；
+// admin_port > 0 时在 127.0.0.1 上监听，每个连接进来写一份报告后关闭（例如 nc 127.0.0.1 PORT）
+bool metrics_start_reporting(unsigned interval_s, unsigned short admin_port);
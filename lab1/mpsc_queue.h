@@ -0,0 +1,54 @@
+#pragma once
+
+// mpsc_queue.h -- 无锁多生产者单消费者队列，用于 reactor 分片之间传递广播
+// 链表实现：生产者只做一次原子交换即可入队，不会互相阻塞；只有所属分片的线程出队。
+// 生产者交换完 head_ 到链接 next 之间有极短的空窗，此时 pop 可能暂时看不到新元素，
+// 调用方在入队之后再唤醒消费者，消费者被唤醒后一定能取到
+
+#include <atomic>
+#include <utility>
+
+template <class T>
+class MpscQueue {
+public:
+    MpscQueue() : head_(&stub_), tail_(&stub_) {}
+    ~MpscQueue() {
+        T value;
+        while (pop(value)) {}
+        if (tail_ != &stub_) delete tail_;
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    // 任意线程调用
+    void push(T value) {
+        Node* n = new Node(std::move(value));
+        Node* prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // 只能由消费者线程调用，队列为空时返回 false
+    bool pop(T& out) {
+        Node* tail = tail_;
+        Node* next = tail->next.load(std::memory_order_acquire);
+        if (!next) return false;
+        // next 成为新的哨兵节点，取走它的值后释放旧哨兵
+        out = std::move(next->value);
+        tail_ = next;
+        if (tail != &stub_) delete tail;
+        return true;
+    }
+
+private:
+    struct Node {
+        Node() = default;
+        explicit Node(T v) : value(std::move(v)) {}
+        std::atomic<Node*> next{ nullptr };
+        T value;
+    };
+
+    Node stub_;
+    alignas(64) std::atomic<Node*> head_;  // 生产者竞争的一端，与消费者的 tail_ 分开缓存行
+    alignas(64) Node* tail_;
+};
@@ -0,0 +1,196 @@
+// msglog.cpp -- 内存映射分段日志实现（仅 Linux）
+#ifdef __linux__
+
+#include "msglog.h"
+#include "framing.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using std::string;
+using std::cerr;
+using std::endl;
+
+#define LOG_RECORD_HEADER 5  // 记录长度 4 字节 + 房间名长度 1 字节
+
+// 段文件名为 8 位序号加 .seg，按序号返回目录中已有的段
+static std::vector<unsigned> list_segments(const string& dir) {
+    std::vector<unsigned> seqs;
+    DIR* d = opendir(dir.c_str());
+    if (!d) return seqs;
+    while (dirent* e = readdir(d)) {
+        unsigned seq;
+        char tail[8];
+        if (sscanf(e->d_name, "%8u.%4s", &seq, tail) == 2 && !strcmp(tail, "seg")) {
+            seqs.push_back(seq);
+        }
+    }
+    closedir(d);
+    std::sort(seqs.begin(), seqs.end());
+    return seqs;
+}
+
+static string segment_path(const string& dir, unsigned seq) {
+    char name[32];
+    snprintf(name, sizeof(name), "/%08u.seg", seq);
+    return dir + name;
+}
+
+MessageLog::~MessageLog() {
+    if (writer_.joinable()) {
+        stop_ = true;
+        uint64_t one = 1;
+        ssize_t r = ::write(wake_fd_, &one, sizeof(one));
+        (void)r;
+        writer_.join();
+    }
+    close_segment();
+    if (wake_fd_ >= 0) close(wake_fd_);
+}
+
+bool MessageLog::open(const string& dir, size_t segment_bytes) {
+    if (mkdir(dir.c_str(), 0755) < 0 && errno != EEXIST) {
+        cerr << "Cannot create log directory " << dir << "." << endl;
+        return false;
+    }
+    dir_ = dir;
+    segment_bytes_ = segment_bytes;
+    std::vector<unsigned> seqs = list_segments(dir);
+    next_seq_ = seqs.empty() ? 0 : seqs.back() + 1;
+
+    wake_fd_ = eventfd(0, EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        cerr << "eventfd failed." << endl;
+        return false;
+    }
+    writer_ = std::thread([this] { run(); });
+    return true;
+}
+
+void MessageLog::scan(const string& dir,
+                      const std::function<void(std::string_view, std::string_view)>& f) {
+    std::vector<unsigned> seqs = list_segments(dir);
+    size_t first = seqs.size() > LOG_SCAN_SEGMENTS ? seqs.size() - LOG_SCAN_SEGMENTS : 0;
+    for (size_t i = first; i < seqs.size(); ++i) {
+        int fd = ::open(segment_path(dir, seqs[i]).c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) continue;
+        struct stat st;
+        if (fstat(fd, &st) < 0 || st.st_size == 0) {
+            close(fd);
+            continue;
+        }
+        size_t size = static_cast<size_t>(st.st_size);
+        void* p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (p == MAP_FAILED) continue;
+
+        const char* data = static_cast<const char*>(p);
+        size_t off = 0;
+        while (off + LOG_RECORD_HEADER <= size) {
+            uint32_t len = get_frame_header(data + off);
+            if (len == 0 || len > size - off - 4) break;  // 段尾或写了一半的记录
+            size_t room_len = static_cast<unsigned char>(data[off + 4]);
+            if (room_len + 1 > len) break;
+            std::string_view room(data + off + LOG_RECORD_HEADER, room_len);
+            std::string_view payload(data + off + LOG_RECORD_HEADER + room_len, len - 1 - room_len);
+            f(room, payload);
+            off += 4 + len;
+        }
+        munmap(p, size);
+    }
+}
+
+void MessageLog::append(const string& room, const FrameRef& frame) {
+    queue_.push(Record{ room, frame });
+    if (!wake_pending_.exchange(true)) {
+        uint64_t one = 1;
+        ssize_t r = ::write(wake_fd_, &one, sizeof(one));
+        (void)r;
+    }
+}
+
+void MessageLog::run() {
+    Record rec;
+    while (1) {
+        uint64_t count;
+        ssize_t r = read(wake_fd_, &count, sizeof(count));
+        (void)r;
+        // 先清标记再取队列，之后追加的记录会再次唤醒
+        wake_pending_.store(false);
+        while (queue_.pop(rec)) write(rec);
+        rec = Record();  // 不再持有最后一帧
+        if (stop_) return;
+    }
+}
+
+void MessageLog::write(const Record& rec) {
+    size_t room_len = std::min<size_t>(rec.room.size(), 255);
+    size_t payload = rec.frame->payload_size();
+    size_t need = LOG_RECORD_HEADER + room_len + payload;
+    if (!map_ || off_ + need > map_size_) {
+        if (!roll(need)) return;
+    }
+    // 先写内容再写长度：进程中途崩溃时，写了一半的记录长度仍为 0，恢复时不会读到
+    char* p = map_ + off_;
+    p[4] = static_cast<char>(room_len);
+    memcpy(p + LOG_RECORD_HEADER, rec.room.data(), room_len);
+    memcpy(p + LOG_RECORD_HEADER + room_len, rec.frame->payload(), payload);
+    put_frame_header(p, static_cast<uint32_t>(need - 4));
+    off_ += need;
+}
+
+// 换到新段；单条记录比段还大时新段按记录大小分配
+bool MessageLog::roll(size_t need) {
+    close_segment();
+    string path = segment_path(dir_, next_seq_++);
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        cerr << "Cannot open log segment " << path << "." << endl;
+        return false;
+    }
+    size_t size = std::max(segment_bytes_, need);
+    if (ftruncate(fd_, static_cast<off_t>(size)) < 0) {
+        cerr << "ftruncate " << path << " failed." << endl;
+        close_segment();
+        return false;
+    }
+    void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+    if (p == MAP_FAILED) {
+        cerr << "mmap " << path << " failed." << endl;
+        close_segment();
+        return false;
+    }
+    map_ = static_cast<char*>(p);
+    map_size_ = size;
+    off_ = 0;
+    return true;
+}
+
+// 关闭当前段，并把文件截到实际写入的长度
+void MessageLog::close_segment() {
+    if (map_) {
+        msync(map_, off_, MS_ASYNC);
+        munmap(map_, map_size_);
+        map_ = nullptr;
+        if (ftruncate(fd_, static_cast<off_t>(off_)) < 0) {
+            cerr << "ftruncate log segment failed." << endl;
+        }
+    }
+    if (fd_ >= 0) close(fd_);
+    fd_ = -1;
+    map_size_ = off_ = 0;
+}
+
+#endif // __linux__
@@ -0,0 +1,74 @@
+#pragma once
+
+// msglog.h -- 只追加的聊天记录（仅 Linux，使用内存映射的分段文件）
+// 日志目录下按序号命名的段文件，每段预先分配固定大小并整体 mmap，追加就是一次 memcpy，
+// 写盘交给内核回写。append 只把记录放进无锁队列，由后台线程写入映射区，广播路径从不等待磁盘。
+// 记录格式：4 字节大端记录长度 + 1 字节房间名长度 + 房间名 + 消息帧正文（JSON），长度为 0 表示段内数据结束
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#include "frame.h"
+#include "framing.h"
+#include "history.h"
+#include "mpsc_queue.h"
+
+#define LOG_SEGMENT_BYTES (64u << 20)
+#define LOG_SCAN_SEGMENTS 4  // 启动时从最新的几个段中恢复历史消息
+
+class MessageLog {
+public:
+    MessageLog() = default;
+    ~MessageLog();
+
+    MessageLog(const MessageLog&) = delete;
+    MessageLog& operator=(const MessageLog&) = delete;
+
+    // 打开（必要时创建）日志目录并启动写线程，新记录写到一个新段中
+    bool open(const std::string& dir, size_t segment_bytes = LOG_SEGMENT_BYTES);
+
+    // 按写入顺序读出目录中最近几个段的记录，用于启动时恢复每个房间的历史
+    static void scan(const std::string& dir,
+                     const std::function<void(std::string_view room, std::string_view payload)>& f);
+
+    // 任意线程调用，不阻塞
+    void append(const std::string& room, const FrameRef& frame);
+
+private:
+    struct Record {
+        std::string room;
+        FrameRef frame;
+    };
+
+    void run();
+    void write(const Record& rec);
+    bool roll(size_t need);
+    void close_segment();
+
+    std::string dir_;
+    size_t segment_bytes_ = LOG_SEGMENT_BYTES;
+    unsigned next_seq_ = 0;
+
+    // 以下只由写线程访问
+    int fd_ = -1;
+    char* map_ = nullptr;
+    size_t map_size_ = 0;
+    size_t off_ = 0;
+
+    MpscQueue<Record> queue_;
+    int wake_fd_ = -1;
+    std::atomic<bool> wake_pending_{ false };
+    std::atomic<bool> stop_{ false };
+    std::thread writer_;
+};
+
+// 用日志中最近的记录填充每个房间的历史，重启后新客户端仍能看到之前的消息
+inline void load_history(const std::string& dir, RoomHistory& history) {
+    MessageLog::scan(dir, [&](std::string_view room, std::string_view payload) {
+        history.add(std::string(room), make_frame(payload));
+    });
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+// 跨平台套接字适配：Windows 下使用 Winsock2，Linux 下映射到 BSD socket，
+// 让 server/client 的同一份代码在两边都能编译
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef _WINSOCK_DEPRECATED_NO_WARNINGS
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+#endif
+
+#include <winsock2.h>  // 必须放在 windows.h 前面
+#include <ws2tcpip.h>
+#include <windows.h>
+
+#pragma comment(lib, "ws2_32.lib")
+
+#define SHUT_RDWR SD_BOTH
+
+#else
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+typedef struct sockaddr SOCKADDR;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR   (-1)
+
+inline int closesocket(SOCKET s) { return close(s); }
+
+#endif
+
+// 初始化网络库：Windows 需要 WSAStartup，Linux 需要忽略 SIGPIPE 防止对端关闭时进程被杀
+inline bool net_startup() {
+#ifdef _WIN32
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+#else
+    signal(SIGPIPE, SIG_IGN);
+    return true;
+#endif
+}
+
+inline void net_cleanup() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
@@ -0,0 +1,117 @@
+// outqueue.cpp -- 有界发送队列实现
+#ifndef _WIN32
+
+#include "outqueue.h"
+
+#include <cerrno>
+#include <sys/uio.h>
+
+#define MAX_IOV 64  // 单次 writev 最多合并的消息数
+
+bool parse_slow_policy(const std::string& name, SlowPolicy& out) {
+    if (name == "drop") out = SlowPolicy::Drop;
+    else if (name == "disconnect") out = SlowPolicy::Disconnect;
+    else if (name == "coalesce") out = SlowPolicy::Coalesce;
+    else return false;
+    return true;
+}
+
+OutQueue::PushResult OutQueue::push(const FrameRef& frame, const OutQueueLimits& limits) {
+    size_t len = wire_size(frame);
+    if (frames() + 1 > limits.max_frames || bytes_ + len > limits.max_bytes) {
+        switch (limits.policy) {
+        case SlowPolicy::Drop:
+            return DROPPED;
+        case SlowPolicy::Disconnect:
+            return OVER_LIMIT;
+        case SlowPolicy::Coalesce:
+            evict_oldest(limits, len);
+            break;
+        }
+    }
+    frames_.push_back(frame);
+    bytes_ += len;
+    return QUEUED;
+}
+
+// 从最旧的消息开始丢弃，直到能放下新消息；已经写出一部分的队首不能丢，否则对端会收到半条消息
+void OutQueue::evict_oldest(const OutQueueLimits& limits, size_t incoming) {
+    size_t first = head_ + (head_off_ > 0 ? 1 : 0);
+    size_t drop_end = first;
+    size_t count = frames_.size() - head_;
+    size_t bytes = bytes_;
+    while (drop_end < frames_.size() &&
+           (count + 1 > limits.max_frames || bytes + incoming > limits.max_bytes)) {
+        bytes -= wire_size(frames_[drop_end]);
+        --count;
+        ++drop_end;
+    }
+    skipped_ += drop_end - first;
+    bytes_ = bytes;
+    frames_.erase(frames_.begin() + first, frames_.begin() + drop_end);
+}
+
+void OutQueue::pop_front() {
+    ++head_;
+    head_off_ = 0;
+    if (head_ == frames_.size()) {
+        // 写空后释放内存，避免曾经拥堵过的空闲连接一直占着大块缓冲区
+        if (frames_.capacity() > 16) std::vector<FrameRef>().swap(frames_);
+        else frames_.clear();
+        head_ = 0;
+    }
+    else if (head_ >= 64 && head_ * 2 >= frames_.size()) {
+        frames_.erase(frames_.begin(), frames_.begin() + head_);
+        head_ = 0;
+    }
+}
+
+int OutQueue::flush(int fd) {
+    while (!empty()) {
+        iovec iov[MAX_IOV];
+        int cnt = 0;
+        for (size_t i = head_; i < frames_.size() && cnt < MAX_IOV; ++i, ++cnt) {
+            size_t off = (i == head_) ? head_off_ : 0;
+            iov[cnt].iov_base = const_cast<char*>(wire_data(frames_[i])) + off;
+            iov[cnt].iov_len = wire_size(frames_[i]) - off;
+        }
+
+        ssize_t n = writev(fd, iov, cnt);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            return -1;
+        }
+
+        size_t left = static_cast<size_t>(n);
+        bytes_ -= left;
+        while (left > 0) {
+            size_t remain = wire_size(frames_[head_]) - head_off_;
+            if (left < remain) {
+                head_off_ += left;
+                return 0;  // 短写：内核缓冲区已满
+            }
+            left -= remain;
+            pop_front();
+        }
+    }
+    return 1;
+}
+
+size_t OutQueue::take(std::vector<FrameRef>& out, size_t max) {
+    size_t n = 0;
+    for (; n < max && !empty(); ++n) {
+        bytes_ -= wire_size(frames_[head_]);
+        out.push_back(std::move(frames_[head_]));
+        pop_front();
+    }
+    return n;
+}
+
+size_t OutQueue::take_skipped() {
+    size_t n = skipped_;
+    skipped_ = 0;
+    return n;
+}
+
+#endif // _WIN32
@@ -0,0 +1,71 @@
+#pragma once
+
+// outqueue.h -- 每个客户端独立的有界发送队列（仅 POSIX，使用 writev 批量写出）
+// 广播只负责入队，不会因为某个读得慢的客户端阻塞其他人
+// 队列里存的是共享帧的引用，同一条广播在所有队列中只占一份内存
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "frame.h"
+#include "framing.h"
+
+// 慢消费者策略：队列超过上限时的处理方式
+enum class SlowPolicy {
+    Drop,        // 丢弃新消息
+    Disconnect,  // 直接断开该客户端
+    Coalesce     // 丢弃最旧的未发送消息，之后补发一条“跳过了 N 条消息”的提示
+};
+
+struct OutQueueLimits {
+    size_t max_bytes = 256 * 1024;
+    size_t max_frames = 1024;
+    SlowPolicy policy = SlowPolicy::Drop;
+};
+
+// 解析命令行中的策略名，无法识别时返回 false
+bool parse_slow_policy(const std::string& name, SlowPolicy& out);
+
+class OutQueue {
+public:
+    enum PushResult {
+        QUEUED,
+        DROPPED,   // Drop 策略下新消息被丢弃
+        OVER_LIMIT  // Disconnect 策略下超限，调用方应关闭连接
+    };
+
+    PushResult push(const FrameRef& frame, const OutQueueLimits& limits);
+
+    // 用 writev 尽可能多地写出，返回 1 表示已写空，0 表示内核缓冲区满，-1 表示出错
+    int flush(int fd);
+
+    // 取出最多 max 条待发送消息交给异步发送（io_uring），返回取出的条数。
+    // 同一个队列不能与 flush 混用，否则队首可能是已经写出一半的消息
+    size_t take(std::vector<FrameRef>& out, size_t max);
+
+    // 该连接实际要发送的字节范围
+    const char* wire_data(const FrameRef& f) const { return framed_ ? f->data() : f->payload(); }
+    size_t wire_size(const FrameRef& f) const { return framed_ ? f->size() : f->payload_size(); }
+
+    // 旧协议连接只发送帧正文，分帧连接连同长度头一起发送
+    void set_wire_mode(WireMode mode) { framed_ = (mode == WireMode::Framed); }
+
+    bool empty() const { return head_ == frames_.size(); }
+    size_t bytes() const { return bytes_; }
+    size_t frames() const { return frames_.size() - head_; }
+
+    // 取出并清零 Coalesce 策略下被丢弃的消息数
+    size_t take_skipped();
+
+private:
+    void pop_front();
+    void evict_oldest(const OutQueueLimits& limits, size_t incoming);
+
+    std::vector<FrameRef> frames_;     // [head_, size) 为待发送消息
+    size_t head_ = 0;
+    size_t head_off_ = 0;              // 队首消息已写出的字节数
+    size_t bytes_ = 0;                 // 队列中尚未写出的字节数
+    size_t skipped_ = 0;
+    bool framed_ = false;
+};
@@ -0,0 +1,876 @@
+// reactor.cpp -- 基于 epoll 或 io_uring 的事件驱动聊天服务器（仅 Linux），可按核心数分片运行多个 reactor
+// g++ -std=c++17 -O2 -o server server.cpp reactor.cpp uring.cpp outqueue.cpp msglog.cpp metrics.cpp asynclog.cpp federation.cpp Message.cpp -pthread
+#ifdef __linux__
+
+#include "reactor.h"
+#include "Message.h"
+#include "asynclog.h"
+#include "framing.h"
+#include "outqueue.h"
+#include "history.h"
+#include "metrics.h"
+#include "mpsc_queue.h"
+#include "msglog.h"
+#include "rooms.h"
+#include "uring.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+using std::string;
+using std::cout;
+using std::cerr;
+using std::endl;
+using std::vector;
+
+#define BUFFER_SIZE (64 * 1024)  // 一次 recv 可能读到多条消息，由 StreamDecoder 逐条切出
+#define MAX_EVENTS 256
+
+#define URING_ENTRIES 4096       // 提交队列长度
+#define URING_BUFFERS 1024       // 接收缓冲区环中的缓冲区个数（2 的幂）
+#define URING_BUFFER_SIZE 4096   // 每个接收缓冲区的大小
+#define URING_BUFFER_GROUP 0
+#define MAX_LINKED_SENDS 64      // 一次链接提交的 send 请求数上限
+
+namespace {
+
+// 每个连接的状态，空闲连接只占用这一个小对象，接收缓冲区由 reactor 共享
+struct Session {
+    int fd = -1;
+    size_t idx = 0;           // 在 online 中的下标，用于 O(1) 删除
+    size_t room_idx = 0;      // 在房间成员数组中的下标，由 RoomRegistry 维护
+    bool logged_in = false;
+    bool failed = false;      // 已标记关闭，等待 flush_closes 回收
+    bool want_out = false;    // 是否已注册 EPOLLOUT
+    bool dirty = false;       // 本轮有新消息入队，等待批量写出
+    Codec codec = Codec::Json; // login 时协商的发送编码
+    string username;
+    string room;              // 当前房间
+    StreamDecoder decoder;    // 按连接的协议（分帧或裸 JSON）切分消息
+    OutQueue out;             // 待发送消息，批次结束时用 writev 一次写出
+
+    // 以下只用于 io_uring 后端
+    int ops = 0;              // 尚未结束的请求数，为 0 且已关闭时才能释放
+    bool sending = false;     // 有一组 send 正在进行，结束前不再提交新的
+    bool closed = false;      // flush_closes 已处理，等待未结束的请求取消
+    vector<FrameRef> inflight; // 正在发送的消息，完成前保持引用
+};
+
+// io_uring 请求的 user_data：会话指针的低 3 位存放请求类型
+enum UringOp : uint64_t {
+    OP_IGNORE = 0,  // 结果不需要处理（取消请求）
+    OP_ACCEPT,
+    OP_WAKE,
+    OP_RECV,
+    OP_SEND
+};
+#define OP_MASK 7ull
+
+inline uint64_t make_user_data(Session* s, UringOp op) {
+    return reinterpret_cast<uint64_t>(s) | op;
+}
+
+// 拿不到提交项、等下一批再补交的请求；op 为 OP_IGNORE 时表示取消该会话的请求
+struct DeferredOp {
+    Session* s;
+    UringOp op;
+};
+
+// 跨分片的广播：源分片把两种编码都编好，目标分片中该房间的所有连接直接共享这两帧
+struct ShardBroadcast {
+    string room;
+    FrameRef json;
+    FrameRef binary;
+    bool keep = false;  // 是否记入房间历史
+};
+
+class Reactor {
+public:
+    Reactor(const ReactorConfig& cfg, const vector<Reactor*>& peers, const RoomHistory& history,
+            MessageLog* log, Federation* fed)
+        : cfg_(cfg), uring_(cfg.backend == Backend::Uring), peers_(peers), history_(history), log_(log),
+          fed_(fed) {}
+    ~Reactor();
+
+    // 在启动线程前完成，绑定失败等错误可以直接报告
+    bool init();
+    int run();
+    int run_uring();
+
+    // 其他分片调用：把一条广播放进本分片的收件队列，必要时唤醒本分片
+    void post(const ShardBroadcast& b);
+
+private:
+    bool setup_listener();
+    void drain_inbox();
+    void on_accept();
+    void on_readable(Session* s);
+    void on_writable(Session* s);
+    void handle_message(Session* s, const MessageView& m);
+
+    void broadcast(const string& room, FrameSet frames, bool keep = false);
+    void deliver(const string& room, FrameSet& frames, bool keep);
+    void replay(Session* s);
+    void notice(Session* s, const string& type, const string& text);
+    void change_room(Session* s, const string& to);
+    void send_to(Session* s, const FrameRef& frame);
+    void update_events(Session* s, bool want_out);
+    void after_flush(Session* s, int r);
+    void flush_dirty();
+
+    void report_skipped(Session* s);
+
+    void fail(Session* s);
+    void flush_closes();
+
+    // io_uring 后端
+    void arm_accept();
+    void arm_wake();
+    void arm_recv(Session* s);
+    void start_send(Session* s);
+    void cancel(Session* s);
+    void release(Session* s);
+    void defer(Session* s, UringOp op);
+    void retry_deferred();
+    void on_completion(const io_uring_cqe& cqe);
+    void on_recv(Session* s, const io_uring_cqe& cqe);
+    void on_send(Session* s, const io_uring_cqe& cqe);
+
+    ReactorConfig cfg_;
+    bool uring_;
+    const vector<Reactor*>& peers_;  // 全部分片（含自己）
+    int epfd_ = -1;
+    int listen_fd_ = -1;
+    int wake_fd_ = -1;              // eventfd，收件队列有新广播时由其他分片写入
+    vector<Session*> online_;   // 已登录的会话
+    RoomRegistry<Session> rooms_;  // 房间名到成员，广播目标
+    RoomHistory history_;          // 每个房间最近的聊天消息，每个分片各存一份（帧本身是共享的）
+    MessageLog* log_;              // 聊天记录，所有分片共用，可以为空
+    Federation* fed_;              // 与其他实例互联，可以为空
+    vector<Session*> closing_;  // 本轮需要关闭的会话
+    vector<Session*> dead_;     // 已关闭但本轮事件里可能仍被引用，批次结束后释放
+    vector<Session*> dirty_;    // 本轮有消息入队的会话
+    vector<DeferredOp> deferred_; // 提交队列满时挂起的 io_uring 请求
+    MpscQueue<ShardBroadcast> inbox_;       // 其他分片发来的广播
+    std::atomic<bool> wake_pending_{ false };  // 已写过 eventfd 且尚未处理，避免每条消息一次系统调用
+    char rbuf_[BUFFER_SIZE];
+    Uring ring_;
+    uint64_t wake_buf_ = 0;  // io_uring 读 eventfd 的目标
+};
+
+// 把进程可打开的文件描述符数量提到硬上限，否则默认 1024 个连接就会 EMFILE
+void raise_fd_limit() {
+    rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+Reactor::~Reactor() {
+    for (Session* s : online_) {
+        close(s->fd);
+        delete s;
+    }
+    for (Session* s : dead_) delete s;
+    if (listen_fd_ >= 0) close(listen_fd_);
+    if (wake_fd_ >= 0) close(wake_fd_);
+    if (epfd_ >= 0) close(epfd_);
+}
+
+bool Reactor::setup_listener() {
+    listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        cerr << "Socket creation failed." << endl;
+        return false;
+    }
+    int on = 1;
+    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    // 每个分片各自监听同一端口，由内核把新连接分散到各分片，accept 不再争抢同一队列
+    if (peers_.size() > 1 && setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+        cerr << "SO_REUSEPORT failed." << endl;
+        return false;
+    }
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(cfg_.port);
+    if (bind(listen_fd_, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+        cerr << "Bind failed." << endl;
+        return false;
+    }
+    if (listen(listen_fd_, cfg_.backlog) < 0) {
+        cerr << "Listen failed." << endl;
+        return false;
+    }
+    if (uring_) return true;  // 由 multishot accept 接收连接
+
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = nullptr;  // data.ptr 为空表示监听套接字
+    return epoll_ctl(epfd_, EPOLL_CTL_ADD, listen_fd_, &ev) == 0;
+}
+
+bool Reactor::init() {
+    if (uring_) {
+        if (!ring_.init(URING_ENTRIES)) {
+            cerr << "io_uring_setup failed: " << strerror(errno) << endl;
+            return false;
+        }
+        if (!ring_.setup_buffers(URING_BUFFER_GROUP, URING_BUFFERS, URING_BUFFER_SIZE)) {
+            cerr << "Registering io_uring buffer ring failed: " << strerror(errno) << endl;
+            return false;
+        }
+        if (!setup_listener()) return false;
+        wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (wake_fd_ < 0) {
+            cerr << "eventfd failed." << endl;
+            return false;
+        }
+        return true;
+    }
+
+    epfd_ = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd_ < 0) {
+        cerr << "epoll_create1 failed." << endl;
+        return false;
+    }
+    if (!setup_listener()) return false;
+
+    wake_fd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (wake_fd_ < 0) {
+        cerr << "eventfd failed." << endl;
+        return false;
+    }
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.ptr = &wake_fd_;  // 唤醒事件，不是会话
+    return epoll_ctl(epfd_, EPOLL_CTL_ADD, wake_fd_, &ev) == 0;
+}
+
+int Reactor::run() {
+    if (uring_) return run_uring();
+    epoll_event events[MAX_EVENTS];
+    while (1) {
+        int n = epoll_wait(epfd_, events, MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            cerr << "epoll_wait failed: " << strerror(errno) << endl;
+            return 1;
+        }
+        for (int i = 0; i < n; ++i) {
+            if (events[i].data.ptr == &wake_fd_) {
+                uint64_t count;
+                ssize_t r = read(wake_fd_, &count, sizeof(count));
+                (void)r;
+                drain_inbox();
+                continue;
+            }
+            Session* s = static_cast<Session*>(events[i].data.ptr);
+            if (!s) {
+                on_accept();
+                continue;
+            }
+            if (s->failed) continue;
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                fail(s);
+            } else {
+                if (events[i].events & EPOLLOUT) on_writable(s);
+                if (!s->failed && (events[i].events & EPOLLIN)) on_readable(s);
+            }
+            flush_closes();
+        }
+        // 本批事件产生的所有广播合并后统一写出，每个客户端一次 writev
+        flush_dirty();
+        // 本批事件处理完后才真正释放会话对象，避免悬空指针
+        for (Session* s : dead_) delete s;
+        dead_.clear();
+    }
+}
+
+void Reactor::on_accept() {
+    while (1) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EMFILE || errno == ENFILE) {
+                cerr << "accept: too many open files." << endl;
+            }
+            return;  // EAGAIN：本轮连接已全部取完
+        }
+        metrics_add(CONN_OPENED);
+        Session* s = new Session;
+        s->fd = fd;
+        epoll_event ev{};
+        ev.events = EPOLLIN;
+        ev.data.ptr = s;
+        if (epoll_ctl(epfd_, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            close(fd);
+            delete s;
+        }
+    }
+}
+
+void Reactor::on_readable(Session* s) {
+    ssize_t bytes = recv(s->fd, rbuf_, BUFFER_SIZE, 0);
+    if (bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) return;
+    if (bytes <= 0) {
+        fail(s);
+        return;
+    }
+    bool ok = s->decoder.feed(rbuf_, bytes, [&](std::string_view payload) {
+        if (s->failed) return;
+        metrics_add(MSG_IN);
+        MessageView view;  // 字段直接指向 rbuf_，不拷贝
+        {
+            MetricTimer timer(HIST_PARSE_NS);
+            view.parse(payload);
+        }
+        handle_message(s, view);
+    });
+    if (!ok) fail(s);
+}
+
+void Reactor::handle_message(Session* s, const MessageView& m) {
+    if (!s->logged_in) {
+        // 首条消息为登录消息
+        s->logged_in = true;
+        s->username = MessageView::unescape(m.user());
+        s->out.set_wire_mode(s->decoder.mode());  // 按客户端使用的协议回复
+        s->idx = online_.size();
+        online_.push_back(s);
+        rooms_.join(s, DEFAULT_ROOM);
+
+        // 分帧客户端在 login 中声明支持二进制编码时，确认后改用二进制发送
+        if (s->decoder.mode() == WireMode::Framed && m.msg() == CODEC_BINARY) {
+            send_to(s, Message("codec", "", string(CODEC_BINARY), get_current_time()).toFrame());
+            s->codec = Codec::Binary;
+        }
+
+        Message join_msg("system", "", s->username + " joined.", get_current_time());
+        broadcast(s->room, FrameSet(join_msg));
+        replay(s);
+        return;
+    }
+
+    if (m.type() == "chat") {
+        if (chat_log.enabled()) chat_log.write(chat_line(m.time(), s->room, m.user(), m.msg()));
+        // 原始字段直接编码成帧，同一编码的接收者共享同一个帧
+        broadcast(s->room, FrameSet(m), true);
+    }
+    else if (m.type() == "join") {
+        string to = MessageView::unescape(m.msg());
+        if (!valid_room_name(to)) notice(s, "error", "Invalid room name.");
+        else change_room(s, to);
+    }
+    else if (m.type() == "part") {
+        change_room(s, DEFAULT_ROOM);
+    }
+    else if (m.type() == "logout") {
+        fail(s);
+    }
+}
+
+// 先发给本分片房间内的连接，再转给其他分片；每个分片内部仍是一次编码、共享同一帧。
+// keep 的消息记入房间历史，并由源分片交给日志线程落盘
+void Reactor::broadcast(const string& room, FrameSet frames, bool keep) {
+    metrics_add(BROADCASTS);
+    deliver(room, frames, keep);
+    if (keep && log_) log_->append(room, frames.get(Codec::Json));
+    if (fed_) fed_->publish(room, frames.get(Codec::Json), keep);
+    if (peers_.size() < 2) return;
+    ShardBroadcast b{ room, frames.get(Codec::Json), frames.get(Codec::Binary), keep };
+    for (Reactor* peer : peers_) {
+        if (peer != this) peer->post(b);
+    }
+}
+
+// 只遍历房间成员，开销与房间大小成正比
+void Reactor::deliver(const string& room, FrameSet& frames, bool keep) {
+    if (keep) history_.add(room, frames.get(Codec::Json));
+    const vector<Session*>* members = rooms_.members(room);
+    if (!members) return;
+    MetricTimer timer(HIST_FANOUT_NS);
+    for (Session* s : *members) {
+        send_to(s, frames.get(s->codec));
+    }
+}
+
+// 把房间最近的消息放进新成员的发送队列，批次结束时与 joined 提示一起用一次 writev 写出
+void Reactor::replay(Session* s) {
+    history_.for_each(s->room, [&](HistoryEntry& e) {
+        send_to(s, e.get(s->codec));
+    });
+}
+
+// 只发给一个客户端的提示
+void Reactor::notice(Session* s, const string& type, const string& text) {
+    send_to(s, Message(type, "", text, get_current_time()).toFrame(s->codec));
+}
+
+// 切换房间：通知原房间有人离开、新房间有人加入
+void Reactor::change_room(Session* s, const string& to) {
+    if (s->room == to) return;
+    string from = s->room;
+    rooms_.join(s, to);
+    broadcast(from, FrameSet(Message("system", "", s->username + " left #" + from + ".", get_current_time())));
+    broadcast(to, FrameSet(Message("system", "", s->username + " joined #" + to + ".", get_current_time())));
+    replay(s);
+}
+
+void Reactor::post(const ShardBroadcast& b) {
+    inbox_.push(b);
+    // 目标分片处理收件队列前只需唤醒一次
+    if (!wake_pending_.exchange(true)) {
+        uint64_t one = 1;
+        ssize_t r = write(wake_fd_, &one, sizeof(one));
+        (void)r;
+    }
+}
+
+// 调用前 eventfd 已被读过
+void Reactor::drain_inbox() {
+    // 先清标记再取队列：之后入队的广播会重新唤醒，不会被漏掉
+    wake_pending_.store(false);
+    ShardBroadcast b;
+    while (inbox_.pop(b)) {
+        FrameSet frames(std::move(b.json), std::move(b.binary));
+        deliver(b.room, frames, b.keep);
+    }
+}
+
+// 只入队不写出：同一批事件里发给同一客户端的多条消息会在 flush_dirty 中合并成一次 writev
+void Reactor::send_to(Session* s, const FrameRef& frame) {
+    if (s->failed) return;
+    switch (s->out.push(frame, cfg_.out_limits)) {
+    case OutQueue::QUEUED:
+        metrics_add(MSG_OUT);
+        metrics_add(BYTES_OUT, s->out.wire_size(frame));
+        break;
+    case OutQueue::DROPPED:
+        return;
+    case OutQueue::OVER_LIMIT:
+        fail(s);
+        return;
+    }
+    // 已注册 EPOLLOUT 的会话等可写事件再发
+    if (!s->dirty && !s->want_out) {
+        s->dirty = true;
+        dirty_.push_back(s);
+    }
+}
+
+void Reactor::on_writable(Session* s) {
+    after_flush(s, s->out.flush(s->fd));
+}
+
+void Reactor::after_flush(Session* s, int r) {
+    if (r < 0) {
+        fail(s);
+        return;
+    }
+    if (r == 0) {
+        update_events(s, true);  // 内核缓冲区满，等待 EPOLLOUT
+        return;
+    }
+    update_events(s, false);
+    report_skipped(s);
+}
+
+// Coalesce 策略：队列写空后告诉客户端中间跳过了多少条消息
+void Reactor::report_skipped(Session* s) {
+    size_t skipped = s->out.take_skipped();
+    if (skipped > 0) {
+        notice(s, "system", std::to_string(skipped) + " messages skipped (slow connection).");
+    }
+}
+
+void Reactor::flush_dirty() {
+    // 写失败会触发离开广播，产生新的待写会话，因此循环到没有为止
+    while (!dirty_.empty()) {
+        vector<Session*> batch;
+        batch.swap(dirty_);
+        for (Session* s : batch) {
+            s->dirty = false;
+            if (s->failed) continue;
+            metrics_record(HIST_QUEUE_DEPTH, s->out.frames());
+            if (uring_) {
+                // 上一组 send 完成时会再检查队列
+                if (!s->sending) start_send(s);
+                continue;
+            }
+            after_flush(s, s->out.flush(s->fd));
+        }
+        flush_closes();
+    }
+}
+
+void Reactor::update_events(Session* s, bool want_out) {
+    if (s->want_out == want_out) return;
+    s->want_out = want_out;
+    epoll_event ev{};
+    ev.events = want_out ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.ptr = s;
+    epoll_ctl(epfd_, EPOLL_CTL_MOD, s->fd, &ev);
+}
+
+// 只做标记，真正的关闭在 flush_closes 中进行，避免在广播循环中修改 online_
+void Reactor::fail(Session* s) {
+    if (s->failed) return;
+    s->failed = true;
+    closing_.push_back(s);
+}
+
+void Reactor::flush_closes() {
+    // 广播离开消息时可能又有连接写失败，因此循环直到没有待关闭会话
+    while (!closing_.empty()) {
+        Session* s = closing_.back();
+        closing_.pop_back();
+        metrics_add(CONN_CLOSED);
+
+        if (uring_) {
+            // 还有请求未结束时先取消，全部结束后才关闭套接字、释放会话
+            s->closed = true;
+            if (s->ops > 0) cancel(s);
+            else release(s);
+        } else {
+            epoll_ctl(epfd_, EPOLL_CTL_DEL, s->fd, nullptr);
+            close(s->fd);
+            dead_.push_back(s);
+        }
+
+        if (!s->logged_in) continue;
+
+        // swap-remove：把最后一个会话挪到空位
+        Session* last = online_.back();
+        online_[s->idx] = last;
+        last->idx = s->idx;
+        online_.pop_back();
+        string room = s->room;
+        rooms_.part(s);
+
+        Message leave_msg("system", "", s->username + " left.", get_current_time());
+        broadcast(room, FrameSet(leave_msg));
+        cout << s->username << " disconnected." << endl;
+    }
+}
+
+int Reactor::run_uring() {
+    arm_accept();
+    arm_wake();
+    while (1) {
+        // 提交上一批产生的请求并等待至少一个完成事件，每批只有这一次系统调用；
+        // 有挂起的请求时不等待，尽快回来补交
+        if (ring_.submit_and_wait(deferred_.empty() ? 1 : 0) < 0 && errno != EINTR && errno != EAGAIN &&
+            errno != EBUSY) {
+            cerr << "io_uring_enter failed: " << strerror(errno) << endl;
+            return 1;
+        }
+        ring_.for_each_cqe([this](const io_uring_cqe& cqe) {
+            on_completion(cqe);
+            flush_closes();
+        });
+        // 本批用完的接收缓冲区一次性还给内核
+        ring_.publish_buffers();
+        retry_deferred();
+        flush_dirty();
+        for (Session* s : dead_) delete s;
+        dead_.clear();
+    }
+}
+
+void Reactor::on_completion(const io_uring_cqe& cqe) {
+    Session* s = reinterpret_cast<Session*>(cqe.user_data & ~OP_MASK);
+    bool more = (cqe.flags & IORING_CQE_F_MORE) != 0;
+    switch (cqe.user_data & OP_MASK) {
+    case OP_ACCEPT:
+        if (cqe.res >= 0) {
+            metrics_add(CONN_OPENED);
+            Session* ns = new Session;
+            ns->fd = cqe.res;
+            arm_recv(ns);
+        } else if (cqe.res == -EMFILE || cqe.res == -ENFILE) {
+            cerr << "accept: too many open files." << endl;
+        }
+        if (!more) arm_accept();
+        break;
+    case OP_WAKE:
+        drain_inbox();
+        arm_wake();
+        break;
+    case OP_RECV:
+        on_recv(s, cqe);
+        break;
+    case OP_SEND:
+        on_send(s, cqe);
+        break;
+    default:
+        break;
+    }
+}
+
+void Reactor::on_recv(Session* s, const io_uring_cqe& cqe) {
+    if (cqe.flags & IORING_CQE_F_BUFFER) {
+        unsigned bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+        if (cqe.res > 0 && !s->failed) {
+            bool ok = s->decoder.feed(ring_.buffer(bid), cqe.res, [&](std::string_view payload) {
+                if (s->failed) return;
+                metrics_add(MSG_IN);
+                MessageView view;  // 字段直接指向内核填好的缓冲区，处理完才把缓冲区还回去
+                {
+                    MetricTimer timer(HIST_PARSE_NS);
+                    view.parse(payload);
+                }
+                handle_message(s, view);
+            });
+            if (!ok) fail(s);
+        }
+        ring_.recycle_buffer(bid);
+    }
+    if (cqe.flags & IORING_CQE_F_MORE) return;
+
+    // multishot 请求已结束：缓冲区暂时用完时重新提交，否则是对端关闭或出错
+    s->ops--;
+    if (s->closed) {
+        if (s->ops == 0) release(s);
+    } else if (!s->failed) {
+        if (cqe.res > 0 || cqe.res == -ENOBUFS) arm_recv(s);
+        else fail(s);
+    }
+}
+
+void Reactor::on_send(Session* s, const io_uring_cqe& cqe) {
+    s->ops--;
+    s->sending = false;
+    s->inflight.clear();
+    if (s->closed) {
+        if (s->ops == 0) release(s);
+        return;
+    }
+    if (s->failed) return;
+    if (cqe.res < 0) {
+        fail(s);
+        return;
+    }
+    // 发送期间又有新消息入队时继续发送，否则队列已写空
+    if (!s->out.empty()) {
+        if (!s->dirty) {
+            s->dirty = true;
+            dirty_.push_back(s);
+        }
+        return;
+    }
+    report_skipped(s);
+}
+
+void Reactor::arm_accept() {
+    io_uring_sqe* sqe = ring_.get_sqe();
+    if (!sqe) {
+        defer(nullptr, OP_ACCEPT);
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd_;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = make_user_data(nullptr, OP_ACCEPT);
+}
+
+void Reactor::arm_wake() {
+    io_uring_sqe* sqe = ring_.get_sqe();
+    if (!sqe) {
+        defer(nullptr, OP_WAKE);
+        return;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = wake_fd_;
+    sqe->addr = reinterpret_cast<uint64_t>(&wake_buf_);
+    sqe->len = sizeof(wake_buf_);
+    sqe->user_data = make_user_data(nullptr, OP_WAKE);
+}
+
+// 一次提交，之后每收到一段数据产生一个完成事件，数据放在内核从缓冲区环中挑出的缓冲区里
+void Reactor::arm_recv(Session* s) {
+    io_uring_sqe* sqe = ring_.get_sqe();
+    if (!sqe) {
+        defer(s, OP_RECV);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = s->fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = make_user_data(s, OP_RECV);
+    s->ops++;
+}
+
+// 把队列中的消息拆成一串链接的 send：按顺序执行，前一个出错后面的全部取消。
+// 中间的 send 成功时不产生完成事件；某个 send 出错时内核只报告它自己，后面被取消的也不再报告，
+// 因此每组恰好产生一个完成事件：最后一个成功，或第一个出错
+// 一组链接必须在同一次提交中送出：get_sqe 在队列满时会先提交已有的提交项，链会被拆成两半，
+// 所以先按剩余空位决定这一组发几条，保证填写过程中不会触发提交
+void Reactor::start_send(Session* s) {
+    if (ring_.sq_space() < MAX_LINKED_SENDS) ring_.submit_and_wait(0);
+    size_t space = ring_.sq_space();
+    if (space == 0) {
+        defer(s, OP_SEND);
+        return;
+    }
+    size_t n = s->out.take(s->inflight, std::min<size_t>(space, MAX_LINKED_SENDS));
+    if (n == 0) return;
+    for (size_t i = 0; i < n; ++i) {
+        const FrameRef& f = s->inflight[i];
+        io_uring_sqe* sqe = ring_.get_sqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = s->fd;
+        sqe->addr = reinterpret_cast<uint64_t>(s->out.wire_data(f));
+        sqe->len = static_cast<uint32_t>(s->out.wire_size(f));
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL;  // 不允许只发出一部分
+        if (i + 1 < n) sqe->flags = IOSQE_IO_LINK | IOSQE_CQE_SKIP_SUCCESS;
+        sqe->user_data = make_user_data(s, OP_SEND);
+    }
+    s->sending = true;
+    s->ops++;
+}
+
+// 取消该连接上所有未结束的请求，它们会以 -ECANCELED 完成
+void Reactor::cancel(Session* s) {
+    io_uring_sqe* sqe = ring_.get_sqe();
+    if (!sqe) {
+        defer(s, OP_IGNORE);
+        return;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = s->fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = make_user_data(nullptr, OP_IGNORE);
+}
+
+void Reactor::release(Session* s) {
+    close(s->fd);
+    dead_.push_back(s);
+}
+
+// 提交队列满且提交不出去时（例如完成队列溢出，io_uring_enter 返回 EBUSY）get_sqe 返回空，
+// 请求先记下来，处理完本批完成事件、腾出空间后再补交。挂起的会话请求计入 ops，补交前会话不会被释放
+void Reactor::defer(Session* s, UringOp op) {
+    deferred_.push_back({ s, op });
+    if (s) s->ops++;
+}
+
+void Reactor::retry_deferred() {
+    vector<DeferredOp> todo;
+    todo.swap(deferred_);
+    for (const DeferredOp& d : todo) {
+        Session* s = d.s;
+        if (!s) {
+            if (d.op == OP_ACCEPT) arm_accept();
+            else arm_wake();
+            continue;
+        }
+        s->ops--;
+        if (s->closed) {
+            // 会话已关闭：不再补交，其余请求已取消或还等着取消
+            if (s->ops == 0) release(s);
+            else if (d.op == OP_IGNORE) cancel(s);
+            continue;
+        }
+        if (s->failed) continue;  // flush_closes 会按剩下的 ops 取消或释放
+        if (d.op == OP_RECV) arm_recv(s);
+        else if (d.op == OP_SEND && !s->sending) start_send(s);
+    }
+}
+
+} // namespace
+
+// 把当前线程固定到一个核心上，分片之间不互相迁移
+static void pin_to_cpu(unsigned cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+int run_epoll_server(const ReactorConfig& cfg) {
+    raise_fd_limit();
+
+    unsigned n = cfg.shards;
+    if (n == 0) n = std::thread::hardware_concurrency();
+    if (n == 0) n = 1;
+
+    // 日志中最近的消息作为各房间的初始历史
+    RoomHistory history(cfg.history);
+    std::unique_ptr<MessageLog> log;
+    if (!cfg.log_dir.empty()) {
+        load_history(cfg.log_dir, history);
+        log.reset(new MessageLog);
+        if (!log->open(cfg.log_dir)) return 1;
+    }
+
+    std::unique_ptr<Federation> fed;
+    if (cfg.federation.port > 0 || !cfg.federation.peers.empty()) fed.reset(new Federation);
+
+    vector<Reactor*> peers;
+    vector<std::unique_ptr<Reactor>> shards;
+    for (unsigned i = 0; i < n; ++i) {
+        shards.emplace_back(new Reactor(cfg, peers, history, log.get(), fed.get()));
+        peers.push_back(shards.back().get());
+    }
+    for (auto& shard : shards) {
+        if (!shard->init()) return 1;
+    }
+    // 其他实例转来的消息与跨分片广播一样放进每个分片的收件队列，只在本地投递
+    if (fed) {
+        MessageLog* log_ptr = log.get();
+        bool ok = fed->start(cfg.federation, [&peers, log_ptr](const string& room, FrameRef json,
+                                                              FrameRef binary, bool keep) {
+            if (keep && log_ptr) log_ptr->append(room, json);
+            ShardBroadcast b{ room, std::move(json), std::move(binary), keep };
+            for (Reactor* r : peers) r->post(b);
+        });
+        if (!ok) return 1;
+    }
+
+    cout << "=== Chat Server Running on port " << cfg.port
+         << (cfg.backend == Backend::Uring ? " (io_uring" : " (epoll");
+    if (n > 1) cout << ", " << n << " shards";
+    cout << ") ===" << endl;
+
+    if (n == 1) return shards[0]->run();
+
+    // 每个分片一个线程，当前线程运行第 0 个分片
+    unsigned cpus = std::thread::hardware_concurrency();
+    vector<std::thread> threads;
+    for (unsigned i = 1; i < n; ++i) {
+        threads.emplace_back([&shards, i, cpus] {
+            if (cpus > 0) pin_to_cpu(i % cpus);
+            shards[i]->run();
+        });
+    }
+    if (cpus > 0) pin_to_cpu(0);
+    int ret = shards[0]->run();
+    for (std::thread& t : threads) t.join();
+    return ret;
+}
+
+#endif // __linux__
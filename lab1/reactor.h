@@ -0,0 +1,35 @@
+#pragma once
+
+// reactor.h -- 基于 epoll 的事件驱动聊天服务器（仅 Linux）
+// 一个线程通过非阻塞套接字管理全部连接，协议与 handle_client 保持一致：
+// 首条消息视为 login，chat 广播给同一房间的人，join/part 切换房间，logout 或断开时广播离开消息
+// 广播只把消息放进各客户端的发送队列，由事件循环批量写出。
+// 分片模式下每个核心运行一个 reactor，各自用 SO_REUSEPORT 监听同一端口、只管理自己的连接，
+// 广播经无锁队列转给其他分片，不再有全局锁；不同分片的客户端看到的消息先后顺序可能不同。
+// io_uring 后端与 epoll 共用同一套会话逻辑，只是把就绪通知换成异步完成：
+// multishot accept/recv 一次提交持续产生事件，接收数据放在注册给内核的缓冲区环中，发送用链接的 send 请求
+
+#include <cstdint>
+#include <string>
+
+#include "federation.h"
+#include "outqueue.h"
+
+enum class Backend {
+    Epoll,
+    Uring
+};
+
+struct ReactorConfig {
+    std::uint16_t port = 8080;
+    int backlog = 1024;  // listen 排队长度，大量并发连接时需要比 5 大得多
+    OutQueueLimits out_limits;  // 每个客户端发送队列的上限与慢消费者策略
+    unsigned shards = 1;  // reactor 线程数，0 表示每个 CPU 核心一个
+    size_t history = 20;  // 进入房间时补发的最近消息条数，0 表示不补发
+    std::string log_dir;  // 聊天记录目录，为空时不写日志
+    Backend backend = Backend::Epoll;
+    FederationConfig federation;  // 端口为 0 且没有 peer 时不与其他实例互联
+};
+
+// 运行 epoll（或 io_uring）服务器主循环，出错时返回非 0
+int run_epoll_server(const ReactorConfig& cfg);
@@ -0,0 +1,60 @@
+#pragma once
+
+// rooms.h -- 聊天房间的成员表
+// 每个客户端同一时间只在一个房间中，登录后进入 DEFAULT_ROOM，join 切换房间，part 回到默认房间。
+// 房间名到成员数组用哈希表索引，成员记住自己在数组中的下标，离开时与最后一个成员交换后删除，
+// 加入和离开都是 O(1)，广播只遍历目标房间的成员
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define DEFAULT_ROOM "lobby"
+#define MAX_ROOM_NAME 64
+
+// 房间名不能为空、不能过长，也不能包含控制字符
+inline bool valid_room_name(const std::string& name) {
+    if (name.empty() || name.size() > MAX_ROOM_NAME) return false;
+    for (unsigned char c : name) {
+        if (c < 0x20) return false;
+    }
+    return true;
+}
+
+// T 需要有 room（所在房间名，空表示不在任何房间）和 room_idx（在成员数组中的下标）两个字段。
+// 不加锁，由调用方保证同一时间只有一个线程修改
+template <class T>
+class RoomRegistry {
+public:
+    // 房间不存在时返回 nullptr
+    const std::vector<T*>* members(const std::string& room) const {
+        auto it = rooms_.find(room);
+        return it == rooms_.end() ? nullptr : &it->second;
+    }
+
+    // 先离开当前房间再加入新房间
+    void join(T* m, const std::string& room) {
+        part(m);
+        std::vector<T*>& list = rooms_[room];
+        m->room = room;
+        m->room_idx = list.size();
+        list.push_back(m);
+    }
+
+    void part(T* m) {
+        if (m->room.empty()) return;
+        auto it = rooms_.find(m->room);
+        std::vector<T*>& list = it->second;
+        T* last = list.back();
+        list[m->room_idx] = last;
+        last->room_idx = m->room_idx;
+        list.pop_back();
+        // 空房间直接删除，房间表只保留有人的房间
+        if (list.empty()) rooms_.erase(it);
+        m->room.clear();
+    }
+
+private:
+    std::unordered_map<std::string, std::vector<T*>> rooms_;
+};
@@ -2,14 +2,28 @@
 #define _WINSOCK_DEPRECATED_NO_WARNINGS 
 #define _CRT_SECURE_NO_WARNINGS        
 
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <mutex>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
 #include <vector>
-#include <winsock2.h>  
-#include <windows.h> 
 
-#pragma comment(lib, "ws2_32.lib")
-
-#include "message.h"
+#include "net_compat.h"
+#include "Message.h"
+#include "asynclog.h"
+#include "federation.h"
+#include "framing.h"
+#include "history.h"
+#include "metrics.h"
+#include "rooms.h"
+#ifdef __linux__
+#include "msglog.h"
+#include "reactor.h"
+#endif
 
 using std::string;
 using std::cout;
@@ -20,148 +34,347 @@ using std::vector;
 #define PORT 8080
 #define BUFFER_SIZE 4096
 
-vector<SOCKET> clients; // 存储所有客户端的套接字
-vector<string> usernames; // 存储所有客户端的用户名
-HANDLE clients_mutex;
+struct ClientInfo {
+    SOCKET sock;
+    string username;
+    WireMode wire_mode;  // 客户端使用的协议（分帧或裸 JSON）
+    Codec codec;         // 协商的编码（JSON 或二进制）
+    string room;         // 所在房间，由 RoomRegistry 维护
+    size_t room_idx = 0;
+};
+
+std::unordered_map<SOCKET, ClientInfo> clients; // 套接字到客户端信息，删除为 O(1)，元素地址不随扩容变化
+RoomRegistry<ClientInfo> rooms; // 房间名到成员
+RoomHistory history(20); // 每个房间最近的聊天消息，进入房间时补发
+#ifdef __linux__
+MessageLog* message_log = nullptr; // 聊天记录，由后台线程写盘
+#endif
+Federation* federation = nullptr; // 与其他实例互相转发广播，未配置时为空
+std::mutex clients_mutex;
+
+// 发送一帧：分帧客户端连同长度头一起发送，旧客户端只发送 JSON
+void send_frame(const ClientInfo& c, const FrameRef& frame) {
+    size_t n;
+    if (c.wire_mode == WireMode::Framed) {
+        n = frame->size();
+        send(c.sock, frame->data(), (int)n, 0);
+    }
+    else {
+        n = frame->payload_size();
+        send(c.sock, frame->payload(), (int)n, 0);
+    }
+    metrics_add(MSG_OUT);
+    metrics_add(BYTES_OUT, n);
+}
+
+// 发送给本实例房间内的所有客户端；keep 的消息记入房间历史和聊天记录
+void deliver_local(const string& room, FrameSet& frames, bool keep) {
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    if (keep) {
+        history.add(room, frames.get(Codec::Json));
+#ifdef __linux__
+        if (message_log) message_log->append(room, frames.get(Codec::Json));
+#endif
+    }
+    const vector<ClientInfo*>* members = rooms.members(room);
+    if (!members) return;
+    metrics_add(BROADCASTS);
+    MetricTimer timer(HIST_FANOUT_NS);
+    for (ClientInfo* c : *members) {
+        // 每种编码只编码一次，同编码的客户端共享同一帧
+        send_frame(*c, frames.get(c->codec));
+    }
+}
+
+// 广播本实例产生的消息：先发给本地客户端，再转给其他实例
+void broadcast(const string& room, FrameSet frames, bool keep = false) {
+    deliver_local(room, frames, keep);
+    if (federation) federation->publish(room, frames.get(Codec::Json), keep);
+}
+
+// 补发房间最近的消息：拼成一块缓冲区，一次 send 发出
+void replay(SOCKET sock, const string& room) {
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    auto it = clients.find(sock);
+    if (it == clients.end()) return;
+    const ClientInfo& c = it->second;
+    string batch;
+    history.for_each(room, [&](HistoryEntry& e) {
+        const FrameRef& f = e.get(c.codec);
+        if (c.wire_mode == WireMode::Framed) batch.append(f->data(), f->size());
+        else batch.append(f->payload(), f->payload_size());
+    });
+    if (!batch.empty()) send(sock, batch.data(), (int)batch.size(), 0);
+}
+
+void send_system(SOCKET sock, const string& type, const string& text) { // 只发给一个客户端的提示
+    std::lock_guard<std::mutex> lock(clients_mutex);
+    auto it = clients.find(sock);
+    if (it == clients.end()) return;
+    send_frame(it->second, Message(type, "", text, get_current_time()).toFrame(it->second.codec));
+}
 
-void broadcast(const string& msg) { // 广播消息，将消息发送到所有客户端
-    WaitForSingleObject(clients_mutex, INFINITE);
-    for (size_t i = 0; i < clients.size(); ++i) {
-        send(clients[i], msg.c_str(), msg.length(), 0);
+// 切换房间：通知原房间有人离开、新房间有人加入
+void change_room(SOCKET sock, const string& username, const string& from, const string& to) {
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        rooms.join(&clients[sock], to);
     }
-    ReleaseMutex(clients_mutex);
+    broadcast(from, FrameSet(Message("system", "", username + " left #" + from + ".", get_current_time())));
+    broadcast(to, FrameSet(Message("system", "", username + " joined #" + to + ".", get_current_time())));
+    replay(sock, to);
 }
 
-DWORD WINAPI handle_client(LPVOID lpParam) { // 定义单线程执行逻辑，处理单个客户端请求
-    SOCKET client_sock = (SOCKET)lpParam;  // 获取传入的客户端套接字
+void handle_client(SOCKET client_sock) { // 定义单线程执行逻辑，处理单个客户端请求
     char buffer[BUFFER_SIZE];
     string username; 
-    
-    // 接收登录消息,并通过Message::from_json解析成Message对象
-    int bytes = recv(client_sock, buffer, BUFFER_SIZE - 1, 0); // 持续接受消息
-    if (bytes <= 0) {
-        closesocket(client_sock);
-        return 0;
-    }
-    buffer[bytes] = '\0';
-    Message login_msg = Message::from_json(string(buffer));
-    username = login_msg.getUser(); // 通过get获取用户昵称
+    string room; // 当前房间，只有本线程会修改
+    bool logged_in = false;
+    bool quit = false;
+    StreamDecoder decoder; // 一次 recv 可能包含多条或半条消息，由解码器切分
+
+    // 处理一条完整消息,通过MessageView单遍解析，字段直接指向buffer
+    auto on_message = [&](std::string_view payload) {
+        if (quit) return;
+        metrics_add(MSG_IN);
+        MessageView msg;
+        {
+            MetricTimer timer(HIST_PARSE_NS);
+            msg.parse(payload);
+        }
 
-    // 添加到客户端列表
-    WaitForSingleObject(clients_mutex, INFINITE);
-    clients.push_back(client_sock);
-    usernames.push_back(username);
-    ReleaseMutex(clients_mutex);
+        if (!logged_in) {
+            // 首条消息为登录消息，通过get获取用户昵称
+            logged_in = true;
+            username = MessageView::unescape(msg.user());
 
-    // 显示新用户加入消息
-    std::string time_str = get_current_time();
-    Message join_msg("system", "", username + " joined.", time_str);
-    // 广播到全部客户端
-    broadcast(join_msg.toString());
+            // 分帧客户端在 login 中声明支持二进制编码时，先发确认，之后改用二进制
+            Codec codec = Codec::Json;
+            if (decoder.mode() == WireMode::Framed && msg.msg() == CODEC_BINARY) {
+                FrameRef ack = Message("codec", "", string(CODEC_BINARY), get_current_time()).toFrame();
+                send(client_sock, ack->data(), (int)ack->size(), 0);
+                codec = Codec::Binary;
+            }
 
-    // 主循环，处理用户聊天消息
-    while (1) {
-        bytes = recv(client_sock, buffer, BUFFER_SIZE - 1, 0); // 持续接受消息
-        if (bytes <= 0) break;
+            // 添加到客户端列表，进入默认房间
+            room = DEFAULT_ROOM;
+            {
+                std::lock_guard<std::mutex> lock(clients_mutex);
+                ClientInfo& info = clients[client_sock];
+                info.sock = client_sock;
+                info.username = username;
+                info.wire_mode = decoder.mode();
+                info.codec = codec;
+                rooms.join(&info, room);
+            }
 
-        buffer[bytes] = '\0';
-        Message chat_msg = Message::from_json(string(buffer)); // 利用工厂方法解析json消息
-        // 解析消息并广播
-        if (chat_msg.getType() == "chat") {
-            cout << "[" << chat_msg.getTime() << "] " << chat_msg.getUser() << ": " << chat_msg.getMsg() << endl;
-            broadcast(chat_msg.toString());
+            // 显示新用户加入消息，广播到房间内的客户端
+            Message join_msg("system", "", username + " joined.", get_current_time());
+            broadcast(room, FrameSet(join_msg));
+            replay(client_sock, room);
+            return;
+        }
+
+        // 解析消息并广播到当前房间
+        if (msg.type() == "chat") {
+            if (chat_log.enabled()) chat_log.write(chat_line(msg.time(), room, msg.user(), msg.msg()));
+            broadcast(room, FrameSet(msg), true);
+        }
+        else if (msg.type() == "join") {
+            string to = MessageView::unescape(msg.msg());
+            if (!valid_room_name(to)) {
+                send_system(client_sock, "error", "Invalid room name.");
+            }
+            else if (to != room) {
+                string from = room;
+                room = to;
+                change_room(client_sock, username, from, to);
+            }
+        }
+        else if (msg.type() == "part") {
+            if (room != DEFAULT_ROOM) {
+                string from = room;
+                room = DEFAULT_ROOM;
+                change_room(client_sock, username, from, room);
+            }
         }
         // 当接受客户端退出时结束管理它的线程
-        else if (chat_msg.getType() == "logout") {
-            break;
+        else if (msg.type() == "logout") {
+            quit = true;
         }
+    };
+
+    // 主循环，持续接受消息
+    while (!quit) {
+        int bytes = recv(client_sock, buffer, BUFFER_SIZE, 0);
+        if (bytes <= 0) break;
+        if (!decoder.feed(buffer, bytes, on_message)) break;
+    }
+
+    metrics_add(CONN_CLOSED);
+    if (!logged_in) {
+        closesocket(client_sock);
+        return;
     }
 
     // 客户端断联处理
-    WaitForSingleObject(clients_mutex, INFINITE);
-    for (size_t i = 0; i < clients.size(); ++i) {
-        if (clients[i] == client_sock) {
-            clients.erase(clients.begin() + i);
-            usernames.erase(usernames.begin() + i);
-            break;
-        }
+    {
+        std::lock_guard<std::mutex> lock(clients_mutex);
+        auto it = clients.find(client_sock);
+        rooms.part(&it->second);
+        clients.erase(it);
     }
-    ReleaseMutex(clients_mutex);
     // 广播用户离开消息
-    time_str = get_current_time(); // 更新时间
-    Message leave_msg("system", "", username + " left.", time_str);
-    broadcast(leave_msg.toString());
+    Message leave_msg("system", "", username + " left.", get_current_time());
+    broadcast(room, FrameSet(leave_msg));
 
     cout << username << " disconnected." << endl;
     closesocket(client_sock);
-    return 0;
 }
 
-int main() {
-    // 初始化Winsock
-    WSADATA wsa;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa) != 0) {
-        cerr << "WSAStartup failed." << endl;
-        return 1;
-    }
-    // 创建互斥锁，保护客户端列表
-    clients_mutex = CreateMutex(NULL, FALSE, NULL);
-    if (!clients_mutex) {
-        cerr << "CreateMutex failed." << endl;
-        WSACleanup();
-        return 1;
-    }
+// 线程模式：每个客户端一个线程（原始实现，Windows/Linux 均可用）
+int run_thread_server(unsigned short port) {
     // 创建监听套接字
     SOCKET server_sock = socket(AF_INET, SOCK_STREAM, 0);
     if (server_sock == INVALID_SOCKET) {
         cerr << "Socket creation failed." << endl;
-        CloseHandle(clients_mutex); 
-        WSACleanup();
         return 1;
     }
     // 绑定和监听
     sockaddr_in addr;
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(PORT);
+    addr.sin_port = htons(port);
 
     if (bind(server_sock, (SOCKADDR*)&addr, sizeof(addr)) == SOCKET_ERROR) {
         cerr << "Bind failed." << endl;
         closesocket(server_sock);
-        CloseHandle(clients_mutex);
-        WSACleanup();
         return 1;
     }
     // 开始监听，最多五个排队
     if (listen(server_sock, 5) == SOCKET_ERROR) {
         cerr << "Listen failed." << endl;
         closesocket(server_sock);
-        CloseHandle(clients_mutex);
-        WSACleanup();
         return 1;
     }
 
-    cout << "=== Chat Server Running on port " << PORT << " ===" << endl;
+    cout << "=== Chat Server Running on port " << port << " ===" << endl;
     // 主循环，接受客户端连接
     while (1) {
         sockaddr_in client_addr;
-        int len = sizeof(client_addr);
+        socklen_t len = sizeof(client_addr);
         // 堵塞等待新链接
         SOCKET client_sock = accept(server_sock, (SOCKADDR*)&client_addr, &len);
         if (client_sock == INVALID_SOCKET) continue;
+        metrics_add(CONN_OPENED);
 
-        HANDLE hThread = CreateThread(NULL, 0, handle_client, (LPVOID)client_sock, 0, NULL);
-        if (hThread) {
-            CloseHandle(hThread);
+        try {
+            std::thread(handle_client, client_sock).detach();
         }
-        else {
+        catch (const std::system_error&) {
             cerr << "Failed to create thread." << endl;
             closesocket(client_sock);
         }
     }
 
     closesocket(server_sock);
-    CloseHandle(clients_mutex);
-    WSACleanup();
     return 0;
+}
+
+void usage() {
+    cerr << "Usage: server [--mode thread|epoll|sharded|uring] [--port N] [--shards N]\n"
+            "              [--history N] [--log-dir DIR] [--print-chat]\n"
+            "              [--stats-interval S] [--admin-port N]\n"
+            "              [--node-id NAME] [--fed-port N] [--peer HOST:PORT]...\n"
+            "              [--slow-policy drop|disconnect|coalesce] [--out-queue-bytes N]" << endl;
+}
+
+int main(int argc, char* argv[]) {
+    string mode = "thread";
+    unsigned short port = PORT;
+    size_t history_len = 20;
+    bool print_chat = false;
+    unsigned stats_interval = 0;
+    unsigned short admin_port = 0;
+    FederationConfig fed;
+#ifdef __linux__
+    ReactorConfig cfg;
+    const char* shards = nullptr;
+#endif
+    for (int i = 1; i < argc; ++i) {
+        if (!strcmp(argv[i], "--mode") && i + 1 < argc) mode = argv[++i];
+        else if (!strcmp(argv[i], "--port") && i + 1 < argc) port = (unsigned short)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--history") && i + 1 < argc) history_len = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--print-chat")) print_chat = true;
+        else if (!strcmp(argv[i], "--stats-interval") && i + 1 < argc) stats_interval = (unsigned)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--admin-port") && i + 1 < argc) admin_port = (unsigned short)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--node-id") && i + 1 < argc) fed.node_id = argv[++i];
+        else if (!strcmp(argv[i], "--fed-port") && i + 1 < argc) fed.port = (unsigned short)atoi(argv[++i]);
+        else if (!strcmp(argv[i], "--peer") && i + 1 < argc) fed.peers.push_back(argv[++i]);
+#ifdef __linux__
+        else if (!strcmp(argv[i], "--log-dir") && i + 1 < argc) cfg.log_dir = argv[++i];
+        else if (!strcmp(argv[i], "--slow-policy") && i + 1 < argc) {
+            if (!parse_slow_policy(argv[++i], cfg.out_limits.policy)) { usage(); return 1; }
+        }
+        else if (!strcmp(argv[i], "--out-queue-bytes") && i + 1 < argc) {
+            cfg.out_limits.max_bytes = strtoul(argv[++i], nullptr, 10);
+        }
+        else if (!strcmp(argv[i], "--shards") && i + 1 < argc) {
+            shards = argv[++i];
+        }
+#endif
+        else { usage(); return 1; }
+    }
+
+    // 初始化Winsock
+    if (!net_startup()) {
+        cerr << "WSAStartup failed." << endl;
+        return 1;
+    }
+    // 逐条聊天输出默认关闭，打开时也由后台线程写出
+    if (print_chat) chat_log.start(stdout);
+    if (!metrics_start_reporting(stats_interval, admin_port)) return 1;
+
+    int ret;
+    if (mode == "thread") {
+        history = RoomHistory(history_len);
+#ifdef __linux__
+        // 日志中最近的消息作为各房间的初始历史
+        MessageLog log;
+        if (!cfg.log_dir.empty()) {
+            load_history(cfg.log_dir, history);
+            if (!log.open(cfg.log_dir)) return 1;
+            message_log = &log;
+        }
+#endif
+        // 其他实例转来的消息只在本地投递，不再发回去
+        Federation fed_node;
+        if (fed.port > 0 || !fed.peers.empty()) {
+            bool ok = fed_node.start(fed, [](const string& room, FrameRef json, FrameRef binary, bool keep) {
+                FrameSet frames(std::move(json), std::move(binary));
+                deliver_local(room, frames, keep);
+            });
+            if (!ok) return 1;
+            federation = &fed_node;
+        }
+        ret = run_thread_server(port);
+    }
+#ifdef __linux__
+    else if (mode == "epoll" || mode == "sharded" || mode == "uring") {
+        // sharded 默认每个核心一个 reactor，--shards 可以指定数量；uring 默认单线程，同样可以分片
+        cfg.port = port;
+        cfg.history = history_len;
+        cfg.shards = shards ? (unsigned)atoi(shards) : (mode == "sharded" ? 0 : 1);
+        if (mode == "uring") cfg.backend = Backend::Uring;
+        cfg.federation = fed;
+        ret = run_epoll_server(cfg);
+    }
+#endif
+    else {
+        usage();
+        ret = 1;
+    }
+
+    net_cleanup();
+    return ret;
 }
\ No newline at end of file
@@ -0,0 +1,148 @@
+// syscount.cpp -- 统计一个进程（含其所有线程）发起的系统调用次数（仅 Linux，基于 ptrace）
+// g++ -std=c++17 -O2 -o syscount syscount.cpp
+// 用法：syscount [-o FILE] -- ./server --mode epoll ...
+// 被跟踪的进程退出时（例如在另一个终端 kill 它）按次数从多到少输出每种系统调用的次数
+#ifdef __linux__
+
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include <sys/ptrace.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// 聊天服务器会用到的系统调用，其余的按编号输出
+static const char* syscall_name(long nr) {
+    static const std::pair<long, const char*> names[] = {
+        { __NR_read, "read" },
+        { __NR_write, "write" },
+        { __NR_readv, "readv" },
+        { __NR_writev, "writev" },
+        { __NR_recvfrom, "recvfrom" },
+        { __NR_sendto, "sendto" },
+        { __NR_recvmsg, "recvmsg" },
+        { __NR_sendmsg, "sendmsg" },
+        { __NR_accept4, "accept4" },
+        { __NR_close, "close" },
+        { __NR_shutdown, "shutdown" },
+        { __NR_epoll_ctl, "epoll_ctl" },
+        { __NR_epoll_pwait, "epoll_pwait" },
+#ifdef __NR_epoll_wait
+        { __NR_epoll_wait, "epoll_wait" },
+#endif
+        { __NR_io_uring_enter, "io_uring_enter" },
+        { __NR_futex, "futex" },
+        { __NR_mmap, "mmap" },
+        { __NR_munmap, "munmap" },
+        { __NR_madvise, "madvise" },
+        { __NR_clone, "clone" },
+#ifdef __NR_clone3
+        { __NR_clone3, "clone3" },
+#endif
+    };
+    for (const auto& n : names) {
+        if (n.first == nr) return n.second;
+    }
+    return nullptr;
+}
+
+static void usage() {
+    fprintf(stderr, "Usage: syscount [-o FILE] -- PROGRAM [ARGS...]\n");
+}
+
+int main(int argc, char* argv[]) {
+    const char* out_path = nullptr;
+    int i = 1;
+    for (; i < argc; ++i) {
+        if (!strcmp(argv[i], "-o") && i + 1 < argc) out_path = argv[++i];
+        else if (!strcmp(argv[i], "--")) { ++i; break; }
+        else { usage(); return 1; }
+    }
+    if (i >= argc) {
+        usage();
+        return 1;
+    }
+
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        return 1;
+    }
+    if (child == 0) {
+        ptrace(PTRACE_TRACEME, 0, nullptr, nullptr);
+        raise(SIGSTOP);  // 等跟踪者设置好选项
+        execvp(argv[i], argv + i);
+        perror("execvp");
+        _exit(127);
+    }
+
+    // Ctrl+C 只交给被跟踪的进程处理，本进程等它退出后再输出结果
+    signal(SIGINT, SIG_IGN);
+
+    int status;
+    if (waitpid(child, &status, 0) < 0 || !WIFSTOPPED(status)) {
+        fprintf(stderr, "Child did not stop.\n");
+        return 1;
+    }
+    // TRACESYSGOOD 区分系统调用停止与信号停止，TRACECLONE 自动跟踪新线程
+    ptrace(PTRACE_SETOPTIONS, child, nullptr,
+           PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, child, nullptr, nullptr);
+
+    std::map<long, unsigned long long> counts;
+    unsigned long long total = 0;
+    while (1) {
+        pid_t pid = waitpid(-1, &status, __WALL);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break;  // ECHILD：所有线程都已退出
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) continue;
+        if (!WIFSTOPPED(status)) continue;
+
+        int sig = WSTOPSIG(status);
+        int deliver = 0;
+        if (sig == (SIGTRAP | 0x80)) {
+            // 每次系统调用会停两次（进入和返回），只在进入时计数
+            __ptrace_syscall_info info;
+            if (ptrace(PTRACE_GET_SYSCALL_INFO, pid, sizeof(info), &info) > 0 &&
+                info.op == PTRACE_SYSCALL_INFO_ENTRY) {
+                ++counts[static_cast<long>(info.entry.nr)];
+                ++total;
+            }
+        } else if (sig == SIGTRAP || sig == SIGSTOP) {
+            // clone 事件，或新线程启动时的 SIGSTOP，不转发
+        } else {
+            deliver = sig;
+        }
+        ptrace(PTRACE_SYSCALL, pid, nullptr, reinterpret_cast<void*>(static_cast<long>(deliver)));
+    }
+
+    std::vector<std::pair<long, unsigned long long>> sorted(counts.begin(), counts.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const auto& a, const auto& b) { return a.second > b.second; });
+
+    FILE* out = out_path ? fopen(out_path, "w") : stderr;
+    if (!out) {
+        perror(out_path);
+        out = stderr;
+    }
+    fprintf(out, "%-16s %12s\n", "syscall", "calls");
+    for (const auto& c : sorted) {
+        const char* name = syscall_name(c.first);
+        if (name) fprintf(out, "%-16s %12llu\n", name, c.second);
+        else fprintf(out, "%-16ld %12llu\n", c.first, c.second);
+    }
+    fprintf(out, "%-16s %12llu\n", "total", total);
+    if (out != stderr) fclose(out);
+    return 0;
+}
+
+#endif // __linux__
@@ -0,0 +1,157 @@
+// uring.cpp -- io_uring 封装实现（仅 Linux）
+#ifdef __linux__
+
+#include "uring.h"
+
+#include <cerrno>
+#include <cstring>
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static int sys_io_uring_setup(unsigned entries, io_uring_params* p) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, p));
+}
+
+static int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, const void* arg, unsigned nr_args) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, nr_args));
+}
+
+Uring::~Uring() {
+    if (br_) munmap(br_, br_size_);
+    if (bufs_) munmap(bufs_, bufs_size_);
+    if (sqes_) munmap(sqes_, sqes_size_);
+    if (cq_ptr_) munmap(cq_ptr_, cq_size_);
+    if (sq_ptr_) munmap(sq_ptr_, sq_size_);
+    if (fd_ >= 0) close(fd_);
+}
+
+bool Uring::init(unsigned entries) {
+    io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE | IORING_SETUP_COOP_TASKRUN;
+    p.cq_entries = entries * 4;
+    fd_ = sys_io_uring_setup(entries, &p);
+    if (fd_ < 0 && errno == EINVAL) {
+        // 较旧的内核不支持 COOP_TASKRUN
+        p.flags &= ~IORING_SETUP_COOP_TASKRUN;
+        fd_ = sys_io_uring_setup(entries, &p);
+    }
+    if (fd_ < 0) return false;
+
+    sq_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single && cq_size_ > sq_size_) sq_size_ = cq_size_;
+
+    sq_ptr_ = mmap(nullptr, sq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                   IORING_OFF_SQ_RING);
+    if (sq_ptr_ == MAP_FAILED) {
+        sq_ptr_ = nullptr;
+        return false;
+    }
+    void* cq = sq_ptr_;
+    if (!single) {
+        cq_ptr_ = mmap(nullptr, cq_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                       IORING_OFF_CQ_RING);
+        if (cq_ptr_ == MAP_FAILED) {
+            cq_ptr_ = nullptr;
+            return false;
+        }
+        cq = cq_ptr_;
+    }
+
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) return false;
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sq_ptr_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = *reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+    sq_entries_ = p.sq_entries;
+    sqe_tail_ = *sq_tail_;
+
+    char* c = static_cast<char*>(cq);
+    cq_head_ = reinterpret_cast<unsigned*>(c + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(c + p.cq_off.tail);
+    cq_mask_ = *reinterpret_cast<unsigned*>(c + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(c + p.cq_off.cqes);
+    return true;
+}
+
+io_uring_sqe* Uring::get_sqe() {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sqe_tail_ - head >= sq_entries_) {
+        submit_and_wait(0);
+        head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+        if (sqe_tail_ - head >= sq_entries_) return nullptr;
+    }
+    unsigned idx = sqe_tail_ & sq_mask_;
+    io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sq_array_[idx] = idx;
+    ++sqe_tail_;
+    return sqe;
+}
+
+int Uring::submit_and_wait(unsigned wait_nr) {
+    unsigned to_submit = sqe_tail_ - *sq_tail_;
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    if (to_submit == 0 && wait_nr == 0) return 0;
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int r;
+    do {
+        r = sys_io_uring_enter(fd_, to_submit, wait_nr, flags);
+    } while (r < 0 && errno == EINTR);
+    return r;
+}
+
+bool Uring::setup_buffers(unsigned short bgid, unsigned count, unsigned size) {
+    buf_count_ = count;
+    buf_size_ = size;
+    br_size_ = count * sizeof(io_uring_buf);
+    void* ring = mmap(nullptr, br_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (ring == MAP_FAILED) return false;
+    br_ = static_cast<io_uring_buf_ring*>(ring);
+
+    bufs_size_ = static_cast<size_t>(count) * size;
+    void* bufs = mmap(nullptr, bufs_size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (bufs == MAP_FAILED) return false;
+    bufs_ = static_cast<char*>(bufs);
+
+    io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<std::uint64_t>(br_);
+    reg.ring_entries = count;
+    reg.bgid = bgid;
+    if (sys_io_uring_register(fd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) return false;
+
+    br_tail_ = 0;
+    for (unsigned i = 0; i < count; ++i) recycle_buffer(i);
+    publish_buffers();
+    return true;
+}
+
+void Uring::recycle_buffer(unsigned bid) {
+    // 不用 br_->bufs：C++ 下头文件里的柔性数组前多了一个空结构体，偏移不是 0
+    io_uring_buf* b = reinterpret_cast<io_uring_buf*>(br_) + (br_tail_ & (buf_count_ - 1));
+    b->addr = reinterpret_cast<std::uint64_t>(buffer(bid));
+    b->len = buf_size_;
+    b->bid = static_cast<unsigned short>(bid);
+    ++br_tail_;
+}
+
+void Uring::publish_buffers() {
+    __atomic_store_n(&br_->tail, br_tail_, __ATOMIC_RELEASE);
+}
+
+#endif // __linux__
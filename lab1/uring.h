@@ -0,0 +1,88 @@
+#pragma once
+
+// uring.h -- 不依赖 liburing 的最小 io_uring 封装（仅 Linux）
+// 直接用 io_uring_setup / io_uring_enter / io_uring_register 系统调用，映射提交队列和完成队列，
+// 并提供一个注册给内核的接收缓冲区环（provided buffer ring）：multishot recv 由内核从环中挑选缓冲区，
+// 用户态处理完数据后再把缓冲区放回环中
+
+#include <cstddef>
+#include <cstdint>
+
+#include <linux/io_uring.h>
+
+class Uring {
+public:
+    Uring() = default;
+    ~Uring();
+
+    Uring(const Uring&) = delete;
+    Uring& operator=(const Uring&) = delete;
+
+    // entries 为提交队列长度，完成队列为其 4 倍，大量连接同时活跃时不易溢出
+    bool init(unsigned entries);
+
+    // 取一个空闲的提交项并清零；队列满时先提交已有的，仍然满（内核拒绝提交，如 EBUSY）时返回空
+    io_uring_sqe* get_sqe();
+
+    // 提交队列剩余的空位，一组链接的请求必须在同一次提交中送出
+    unsigned sq_space() const { return sq_entries_ - (sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE)); }
+
+    // 提交所有新的提交项，并等待至少 wait_nr 个完成事件，返回 io_uring_enter 的结果
+    int submit_and_wait(unsigned wait_nr);
+
+    // 依次处理所有已完成事件，处理完后统一推进完成队列头，返回处理的个数
+    template <class F>
+    unsigned for_each_cqe(F&& f);
+
+    // 注册接收缓冲区环：count 个（2 的幂）大小为 size 的缓冲区，组号为 bgid
+    bool setup_buffers(unsigned short bgid, unsigned count, unsigned size);
+    char* buffer(unsigned bid) const { return bufs_ + static_cast<size_t>(bid) * buf_size_; }
+    unsigned buffer_size() const { return buf_size_; }
+    // 把用完的缓冲区放回环中，对内核可见要等到 publish_buffers
+    void recycle_buffer(unsigned bid);
+    void publish_buffers();
+
+private:
+    int fd_ = -1;
+
+    // 提交队列
+    void* sq_ptr_ = nullptr;
+    size_t sq_size_ = 0;
+    unsigned* sq_head_ = nullptr;
+    unsigned* sq_tail_ = nullptr;
+    unsigned* sq_array_ = nullptr;
+    unsigned sq_mask_ = 0;
+    unsigned sq_entries_ = 0;
+    unsigned sqe_tail_ = 0;       // 本地已填写到的位置，提交时才写回共享的 tail
+    io_uring_sqe* sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    // 完成队列（与提交队列共用一次映射时 cq_ptr_ 为空）
+    void* cq_ptr_ = nullptr;
+    size_t cq_size_ = 0;
+    unsigned* cq_head_ = nullptr;
+    unsigned* cq_tail_ = nullptr;
+    unsigned cq_mask_ = 0;
+    io_uring_cqe* cqes_ = nullptr;
+
+    // 接收缓冲区环
+    io_uring_buf_ring* br_ = nullptr;
+    size_t br_size_ = 0;
+    char* bufs_ = nullptr;
+    size_t bufs_size_ = 0;
+    unsigned buf_count_ = 0;
+    unsigned buf_size_ = 0;
+    unsigned short br_tail_ = 0;
+};
+
+template <class F>
+unsigned Uring::for_each_cqe(F&& f) {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    unsigned n = tail - head;
+    for (; head != tail; ++head) {
+        f(cqes_[head & cq_mask_]);
+    }
+    __atomic_store_n(cq_head_, tail, __ATOMIC_RELEASE);
+    return n;
+}
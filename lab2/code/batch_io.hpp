@@ -0,0 +1,318 @@
+#pragma once
+
+// batch_io.hpp -- 批量收发 UDP 报文
+// Plain：每个报文一次 sendto/recvfrom（原来的做法，也是非 Linux 平台唯一的方式）
+// Mmsg ：Linux 下 sendmmsg 一次发出积攒的所有报文，recvmmsg 一次取出已到达的所有报文
+// Gso  ：在 Mmsg 基础上，把连续的等长报文合成一个 UDP_SEGMENT 超大报文交给内核切分，
+//        接收端打开 UDP_GRO，内核把同一流的报文合并后一次交上来，这里再按段长切开
+// 发送端只记录报文的指针和长度，flush 之前数据必须保持有效。
+// 报文可以分头部和数据两段给出（数据直接来自映射的文件），由内核拼成一个报文
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "net_compat.hpp"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+#ifdef __linux__
+#include <netinet/udp.h>
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+#ifndef UDP_GRO
+#define UDP_GRO 104
+#endif
+#endif
+
+#define BATCH_MAX 64               // 一次系统调用最多的报文（或超大报文）数
+#define GSO_MAX_SEGS 64            // 一个 GSO 超大报文最多的段数（内核限制）
+#define GSO_MAX_BYTES 65507        // IPv4 UDP 报文的最大负载
+#define GRO_BUF_SIZE 65536         // 打开 GRO 时每个接收缓冲区的大小
+
+enum class IoMode { Plain, Mmsg, Gso };
+
+// 解析命令行中的名字，无法识别时返回 false
+inline bool parseIoMode(const std::string& name, IoMode& out) {
+    if (name == "plain") out = IoMode::Plain;
+    else if (name == "mmsg") out = IoMode::Mmsg;
+    else if (name == "gso") out = IoMode::Gso;
+    else return false;
+    return true;
+}
+
+class UdpBatchSender {
+public:
+    // peer 指向的地址在每次 flush 时读取，可以在运行中更新
+    UdpBatchSender(SOCKET s, const sockaddr_in* peer, IoMode mode) : sock_(s), peer_(peer), mode_(mode) {
+#ifndef __linux__
+        mode_ = IoMode::Plain;
+#endif
+        pkts_.reserve(BATCH_MAX * GSO_MAX_SEGS);
+    }
+
+    void add(const char* data, int len) { add(data, len, nullptr, 0); }
+
+    void add(const char* hdr, int hdrLen, const char* payload, int payloadLen) {
+        pkts_.push_back({ hdr, hdrLen, payload, payloadLen });
+        if (pkts_.size() >= (mode_ == IoMode::Gso ? BATCH_MAX * GSO_MAX_SEGS : BATCH_MAX)) flush();
+    }
+
+    void flush() {
+        if (pkts_.empty()) return;
+#ifdef __linux__
+        if (mode_ == IoMode::Mmsg) flushMmsg(0);
+        else if (mode_ == IoMode::Gso) flushGso();
+        else
+#endif
+        for (const Pkt& p : pkts_) {
+            sendOne(p);
+        }
+        pkts_.clear();
+    }
+
+    std::uint64_t syscalls() const { return syscalls_; }
+    IoMode mode() const { return mode_; }
+
+private:
+    struct Pkt {
+        const char* hdr;
+        int hdrLen;
+        const char* payload;  // 没有第二段时为空
+        int payloadLen;
+    };
+
+    // 单个报文：有两段时用 gather 发送，避免先拼到一个缓冲区里
+    void sendOne(const Pkt& p) {
+        ++syscalls_;
+        if (!p.payload) {
+            sendto(sock_, p.hdr, p.hdrLen, 0, reinterpret_cast<const sockaddr*>(peer_), sizeof(*peer_));
+            return;
+        }
+#ifdef _WIN32
+        WSABUF bufs[2] = { { static_cast<ULONG>(p.hdrLen), const_cast<char*>(p.hdr) },
+                           { static_cast<ULONG>(p.payloadLen), const_cast<char*>(p.payload) } };
+        DWORD sent = 0;
+        WSASendTo(sock_, bufs, 2, &sent, 0, reinterpret_cast<const sockaddr*>(peer_), sizeof(*peer_), nullptr, nullptr);
+#else
+        iovec iov[2];
+        msghdr h;
+        fillHeader(h, iov, fillIov(iov, p));
+        sendmsg(sock_, &h, 0);
+#endif
+    }
+
+#ifndef _WIN32
+    static size_t fillIov(iovec* iov, const Pkt& p) {
+        iov[0].iov_base = const_cast<char*>(p.hdr);
+        iov[0].iov_len = p.hdrLen;
+        if (!p.payload) return 1;
+        iov[1].iov_base = const_cast<char*>(p.payload);
+        iov[1].iov_len = p.payloadLen;
+        return 2;
+    }
+
+    void fillHeader(msghdr& h, iovec* iov, size_t iovlen) {
+        std::memset(&h, 0, sizeof(h));
+        h.msg_name = const_cast<sockaddr_in*>(peer_);
+        h.msg_namelen = sizeof(*peer_);
+        h.msg_iov = iov;
+        h.msg_iovlen = iovlen;
+    }
+#endif
+
+#ifdef __linux__
+    // 发出 msgs 中的 n 条消息，返回成功发出的条数；部分发送时继续发剩余的，
+    // 出错就放弃剩余报文（由重传补上）
+    int sendAll(mmsghdr* msgs, int n) {
+        int done = 0;
+        while (done < n) {
+            int r = sendmmsg(sock_, msgs + done, n - done, 0);
+            ++syscalls_;
+            if (r <= 0) {
+                if (r < 0 && errno == EINTR) continue;
+                return r < 0 && mode_ == IoMode::Gso && (errno == EIO || errno == EINVAL || errno == ENOPROTOOPT)
+                           ? -1 - done : done;
+            }
+            done += r;
+        }
+        return done;
+    }
+
+    // 从第 from 个报文开始发出
+    void flushMmsg(size_t from) {
+        mmsghdr msgs[BATCH_MAX];
+        iovec iov[BATCH_MAX * 2];
+        for (size_t base = from; base < pkts_.size(); base += BATCH_MAX) {
+            int n = 0;
+            size_t used = 0;
+            for (size_t i = base; i < pkts_.size() && n < BATCH_MAX; ++i, ++n) {
+                size_t k = fillIov(&iov[used], pkts_[i]);
+                fillHeader(msgs[n].msg_hdr, &iov[used], k);
+                used += k;
+            }
+            sendAll(msgs, n);
+        }
+    }
+
+    // 连续的等长报文合成一组（最后一个可以更短），每组一个带 UDP_SEGMENT 的消息，各组再用一次 sendmmsg 发出。
+    // 内核按段长切分拼接后的数据，所以每个报文分成几段 iovec 都没关系
+    void flushGso() {
+        mmsghdr msgs[BATCH_MAX];
+        iovec iov[BATCH_MAX * GSO_MAX_SEGS * 2];
+        size_t firstPkt[BATCH_MAX];
+        char ctrl[BATCH_MAX][CMSG_SPACE(sizeof(std::uint16_t))];
+        size_t i = 0;
+        while (i < pkts_.size()) {
+            int n = 0;
+            size_t used = 0;
+            while (i < pkts_.size() && n < BATCH_MAX) {
+                int seg = pkts_[i].hdrLen + pkts_[i].payloadLen;
+                size_t first = used;
+                int segs = 0;
+                size_t bytes = 0;
+                firstPkt[n] = i;
+                while (i < pkts_.size() && segs < GSO_MAX_SEGS) {
+                    int len = pkts_[i].hdrLen + pkts_[i].payloadLen;
+                    if (len > seg || bytes + len > GSO_MAX_BYTES) break;
+                    used += fillIov(&iov[used], pkts_[i]);
+                    bytes += len;
+                    ++segs;
+                    ++i;
+                    if (len < seg) break;  // 短报文只能放在最后
+                }
+                msghdr& h = msgs[n].msg_hdr;
+                fillHeader(h, &iov[first], used - first);
+                if (segs > 1) {
+                    h.msg_control = ctrl[n];
+                    h.msg_controllen = sizeof(ctrl[n]);
+                    cmsghdr* cm = CMSG_FIRSTHDR(&h);
+                    cm->cmsg_level = SOL_UDP;
+                    cm->cmsg_type = UDP_SEGMENT;
+                    cm->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+                    std::uint16_t size = static_cast<std::uint16_t>(seg);
+                    std::memcpy(CMSG_DATA(cm), &size, sizeof(size));
+                }
+                ++n;
+            }
+            int done = sendAll(msgs, n);
+            if (done < 0) {
+                // 内核不支持 UDP_SEGMENT：以后都用普通批量发送，本次从失败的那组开始重发
+                mode_ = IoMode::Mmsg;
+                flushMmsg(firstPkt[-1 - done]);
+                return;
+            }
+        }
+    }
+#endif
+
+    SOCKET sock_;
+    const sockaddr_in* peer_;
+    IoMode mode_;
+    std::vector<Pkt> pkts_;
+    std::uint64_t syscalls_ = 0;
+};
+
+class UdpBatchReceiver {
+public:
+    // maxPacket 为单个报文的最大长度；Gso 模式下打开 UDP_GRO，失败时退回 Mmsg
+    UdpBatchReceiver(SOCKET s, IoMode mode, int maxPacket) : sock_(s), mode_(mode) {
+#ifdef __linux__
+        if (mode_ == IoMode::Gso) {
+            int on = 1;
+            if (setsockopt(sock_, SOL_UDP, UDP_GRO, &on, sizeof(on)) != 0) mode_ = IoMode::Mmsg;
+        }
+#else
+        mode_ = IoMode::Plain;
+#endif
+        bufSize_ = mode_ == IoMode::Gso ? GRO_BUF_SIZE : maxPacket;
+        int slots = mode_ == IoMode::Plain ? 1 : BATCH_MAX;
+        bufs_.resize(static_cast<size_t>(slots) * bufSize_);
+        addrs_.resize(slots);
+        segs_.reserve(mode_ == IoMode::Gso ? BATCH_MAX * GSO_MAX_SEGS : slots);
+    }
+
+    // 阻塞等待至少一个报文（受套接字接收超时限制），再取出所有已到达的，返回报文数；超时或出错返回 -1
+    int receive() {
+        segs_.clear();
+#ifdef __linux__
+        if (mode_ != IoMode::Plain) return receiveMmsg();
+#endif
+        socklen_t len = sizeof(addrs_[0]);
+        int n = recvfrom(sock_, bufs_.data(), bufSize_, 0, reinterpret_cast<sockaddr*>(&addrs_[0]), &len);
+        ++syscalls_;
+        if (n <= 0) return -1;
+        segs_.push_back({ bufs_.data(), n, 0 });
+        return 1;
+    }
+
+    const char* data(int i) const { return segs_[i].data; }
+    int len(int i) const { return segs_[i].len; }
+    const sockaddr_in& from(int i) const { return addrs_[segs_[i].msg]; }
+    std::uint64_t syscalls() const { return syscalls_; }
+
+private:
+    struct Seg {
+        const char* data;
+        int len;
+        int msg;  // 来自第几条消息，用来取源地址
+    };
+
+#ifdef __linux__
+    int receiveMmsg() {
+        mmsghdr msgs[BATCH_MAX];
+        iovec iov[BATCH_MAX];
+        char ctrl[BATCH_MAX][CMSG_SPACE(sizeof(int))];
+        for (int i = 0; i < BATCH_MAX; ++i) {
+            iov[i].iov_base = bufs_.data() + static_cast<size_t>(i) * bufSize_;
+            iov[i].iov_len = bufSize_;
+            msghdr& h = msgs[i].msg_hdr;
+            std::memset(&h, 0, sizeof(h));
+            h.msg_name = &addrs_[i];
+            h.msg_namelen = sizeof(addrs_[i]);
+            h.msg_iov = &iov[i];
+            h.msg_iovlen = 1;
+            if (mode_ == IoMode::Gso) {
+                h.msg_control = ctrl[i];
+                h.msg_controllen = sizeof(ctrl[i]);
+            }
+        }
+        int n = recvmmsg(sock_, msgs, BATCH_MAX, MSG_WAITFORONE, nullptr);
+        ++syscalls_;
+        if (n <= 0) return -1;
+        for (int i = 0; i < n; ++i) {
+            const char* p = static_cast<const char*>(iov[i].iov_base);
+            int total = static_cast<int>(msgs[i].msg_len);
+            int seg = total;
+            // GRO 合并过的消息带段长，按段长切开
+            if (mode_ == IoMode::Gso) {
+                for (cmsghdr* cm = CMSG_FIRSTHDR(&msgs[i].msg_hdr); cm; cm = CMSG_NXTHDR(&msgs[i].msg_hdr, cm)) {
+                    if (cm->cmsg_level == SOL_UDP && cm->cmsg_type == UDP_GRO) {
+                        int v;
+                        std::memcpy(&v, CMSG_DATA(cm), sizeof(v));
+                        if (v > 0) seg = v;
+                    }
+                }
+            }
+            for (int off = 0; off < total; off += seg) {
+                segs_.push_back({ p + off, std::min(seg, total - off), i });
+            }
+        }
+        return static_cast<int>(segs_.size());
+    }
+#endif
+
+    SOCKET sock_;
+    IoMode mode_;
+    int bufSize_ = 0;
+    std::vector<char> bufs_;
+    std::vector<sockaddr_in> addrs_;
+    std::vector<Seg> segs_;
+    std::uint64_t syscalls_ = 0;
+};
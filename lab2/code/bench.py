@@ -0,0 +1,217 @@
+"""bench.py -- 本机自动跑传输基准，把每次结果写成一行 CSV
+
+对 拥塞控制 × 丢包率 × 接收窗口 × MSS × 文件大小 的每个组合，用不同的随机种子各跑若干次：
+  - 每种 MSS 编译一份 sender/receiver（g++ -DMSS=N），放在 --build 目录下，源文件没变时不重新编译
+  - 测试文件按大小用固定种子生成，同样的大小每次内容相同
+  - 丢包由接收端按 --seed 模拟；给了 --proxy 时改为经 impair_proxy 转发，丢包加在正向链路上，
+    --proxy 的其余参数（时延、限速等）原样传给代理
+每行：参数、完成时间、goodput、重传次数与重传率、文件是否一致、失败原因，以及降采样后的拥塞窗口轨迹
+（"毫秒:cwnd" 以空格分隔）。失败原因区分握手失败（handshake）、超时（timeout）、文件不一致（mismatch）
+和没有输出结果（error），成功时为空。结束时按组合打印完成时间和 goodput 的中位数以及各类失败次数。
+
+用法：python3 bench.py [--cc reno,cubic,bbr] [--loss 0,0.05,0.1] [--window 1024] [--mss 1024]
+                       [--size 1M] [--seeds 3] [--io mmsg] [--proxy "--delay 5 --rate 100"]
+                       [--out bench.csv] [--build _bench] [--timeout 60]
+"""
+
+import argparse
+import csv
+import filecmp
+import itertools
+import os
+import random
+import re
+import shlex
+import statistics
+import subprocess
+import sys
+import time
+
+HERE = os.path.dirname(os.path.abspath(__file__))
+SOURCES = ['sender.cpp', 'receiver.cpp', 'impair_proxy.cpp']
+HEADERS = ['rdt.hpp', 'net_compat.hpp', 'batch_io.hpp', 'congestion.hpp', 'file_map.hpp',
+           'seq_ring.hpp', 'timer_wheel.hpp', 'impair.hpp']
+BASE_PORT = 42000
+TRACE_POINTS = 100   # 每行最多保留的轨迹点数
+
+COLUMNS = ['cc', 'loss', 'window', 'mss', 'size', 'seed', 'io', 'time_ms', 'goodput_mbps',
+           'retrans', 'segments', 'retrans_ratio', 'ok', 'fail', 'cwnd_trace']
+
+
+def parse_size(s):
+    """1024、64K、8M 这样的大小"""
+    m = re.fullmatch(r'(\d+)([KkMm]?)', s)
+    if not m:
+        raise argparse.ArgumentTypeError(f'bad size: {s}')
+    return int(m.group(1)) * {'': 1, 'k': 1 << 10, 'm': 1 << 20}[m.group(2).lower()]
+
+
+def list_of(conv):
+    return lambda s: [conv(x) for x in s.split(',') if x]
+
+
+def build(mss, build_dir, cxx):
+    """编译一份指定 MSS 的程序，返回 {名字: 路径}"""
+    out = os.path.join(build_dir, f'mss{mss}')
+    os.makedirs(out, exist_ok=True)
+    newest = max(os.path.getmtime(os.path.join(HERE, f)) for f in SOURCES + HEADERS)
+    bins = {}
+    for src in SOURCES:
+        name = os.path.splitext(src)[0]
+        exe = os.path.join(out, name)
+        bins[name] = exe
+        if os.path.exists(exe) and os.path.getmtime(exe) >= newest:
+            continue
+        cmd = [cxx, '-std=c++17', '-O2', f'-DMSS={mss}', '-o', exe, os.path.join(HERE, src), '-pthread']
+        print('build:', ' '.join(cmd), flush=True)
+        subprocess.run(cmd, check=True)
+    return bins
+
+
+def make_file(size, build_dir):
+    path = os.path.join(build_dir, f'data_{size}.bin')
+    if not os.path.exists(path) or os.path.getsize(path) != size:
+        rng = random.Random(size)
+        with open(path, 'wb') as f:
+            f.write(rng.randbytes(size))
+    return path
+
+
+def read_trace(path):
+    """读 sender --trace 的输出，均匀降采样到 TRACE_POINTS 个点"""
+    try:
+        with open(path) as f:
+            rows = list(csv.DictReader(f))
+    except OSError:
+        return ''
+    if len(rows) > TRACE_POINTS:
+        step = (len(rows) - 1) / (TRACE_POINTS - 1)
+        rows = [rows[round(i * step)] for i in range(TRACE_POINTS)]
+    return ' '.join(f"{r['ms']}:{float(r['cwnd']):.2f}" for r in rows)
+
+
+def run_one(bins, point, seed, port, args):
+    """跑一次传输，返回一行结果"""
+    cc, loss, window, mss, size = point
+    src = make_file(size, args.build)
+    dst = os.path.join(args.build, f'recv_{port}.bin')
+    trace = os.path.join(args.build, f'trace_{port}.csv')
+    for p in (dst, trace):
+        if os.path.exists(p):
+            os.remove(p)
+
+    procs = []
+    target = port
+    recv_loss = loss
+    if args.proxy is not None:
+        # 代理监听 port + 1，接收端不再自己丢包
+        target = port + 1
+        recv_loss = 0
+        procs.append(subprocess.Popen(
+            [bins['impair_proxy'], '--listen', str(target), '--port', str(port), '--seed', str(seed),
+             '--quiet', '--fwd-loss', str(loss)] + shlex.split(args.proxy),
+            stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL))
+    receiver = subprocess.Popen(
+        [bins['receiver'], '--port', str(port), '--loss', str(recv_loss), '--seed', str(seed),
+         '--window', str(window), '--io', args.io, '--out', dst, '--quiet'],
+        stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    procs.append(receiver)
+    time.sleep(0.2)  # 等接收端绑定端口
+
+    row = dict(zip(COLUMNS[:7], [cc, loss, window, mss, size, seed, args.io]))
+    segments = -(-size // mss)
+    row.update(time_ms='', goodput_mbps='', retrans='', segments=segments, retrans_ratio='',
+               ok=0, fail='', cwnd_trace='')
+    out = ''
+    try:
+        out = subprocess.run(
+            [bins['sender'], '--port', str(target), '--cc', cc, '--io', args.io, '--file', src,
+             '--trace', trace, '--quiet'],
+            capture_output=True, text=True, timeout=args.timeout).stdout
+        receiver.wait(timeout=5)
+        t = float(re.search(r'^Time : ([\d.]+) ms', out, re.M).group(1))
+        retrans = int(re.search(r'^Retrans : (\d+)', out, re.M).group(1))
+        ok = filecmp.cmp(src, dst, shallow=False)
+        row.update(time_ms=f'{t:.3f}', goodput_mbps=f'{size * 8 / t / 1000:.3f}', retrans=retrans,
+                   retrans_ratio=f'{retrans / segments:.4f}', ok=int(ok), fail='' if ok else 'mismatch',
+                   cwnd_trace=read_trace(trace))
+    except subprocess.TimeoutExpired as e:
+        # 超时时拿到的输出总是 bytes
+        out = (e.stdout or b'').decode(errors='replace')
+        row['fail'] = 'timeout'
+    except (AttributeError, OSError):
+        row['fail'] = 'error'
+    finally:
+        for p in procs:
+            if p.poll() is None:
+                p.kill()
+            p.wait()
+    for p in (dst, trace):
+        if os.path.exists(p):
+            os.remove(p)
+    # 握手没完成时后面的一切都没开始，单独归类，不和传输本身的失败混在一起
+    if row['fail'] and 'Handshake done' not in out:
+        row['fail'] = 'handshake'
+    return row
+
+
+def main():
+    ap = argparse.ArgumentParser(description='RDT transfer benchmark sweep')
+    ap.add_argument('--cc', type=list_of(str), default=['reno', 'cubic', 'bbr'])
+    ap.add_argument('--loss', type=list_of(float), default=[0, 0.05, 0.1])
+    ap.add_argument('--window', type=list_of(int), default=[1024], help='接收窗口（报文段数）')
+    ap.add_argument('--mss', type=list_of(int), default=[1024])
+    ap.add_argument('--size', type=list_of(parse_size), default=[1 << 20])
+    ap.add_argument('--seeds', type=int, default=3, help='每个组合重复的次数，种子为 1..N')
+    ap.add_argument('--io', default='mmsg', choices=['plain', 'mmsg', 'gso'])
+    ap.add_argument('--proxy', default=None, help='经 impair_proxy 转发，值为额外的代理参数（可为空串）')
+    ap.add_argument('--out', default='bench.csv')
+    ap.add_argument('--build', default='_bench')
+    ap.add_argument('--cxx', default='g++')
+    ap.add_argument('--timeout', type=float, default=60)
+    args = ap.parse_args()
+
+    os.makedirs(args.build, exist_ok=True)
+    bins = {mss: build(mss, args.build, args.cxx) for mss in args.mss}
+
+    points = list(itertools.product(args.cc, args.loss, args.window, args.mss, args.size))
+    total = len(points) * args.seeds
+    summary = {}
+    failures = {}
+    port = BASE_PORT
+    with open(args.out, 'w', newline='') as f:
+        w = csv.DictWriter(f, fieldnames=COLUMNS)
+        w.writeheader()
+        n = 0
+        for point in points:
+            for seed in range(1, args.seeds + 1):
+                n += 1
+                # 每次换一对端口，上一次的接收端可能还在应答重发的 FIN
+                port = BASE_PORT + (port - BASE_PORT + 2) % 2000
+                row = run_one(bins[point[3]], point, seed, port, args)
+                w.writerow(row)
+                f.flush()
+                print(f'[{n}/{total}] cc={point[0]} loss={point[1]} win={point[2]} mss={point[3]} '
+                      f'size={point[4]} seed={seed} -> '
+                      + (f'{row["time_ms"]} ms' if row['ok'] else f'failed ({row["fail"]})'),
+                      flush=True)
+                if row['ok']:
+                    summary.setdefault(point, []).append((float(row['time_ms']), float(row['goodput_mbps'])))
+                else:
+                    failures.setdefault(point, {}).setdefault(row['fail'], 0)
+                    failures[point][row['fail']] += 1
+
+    print('\ncc,loss,window,mss,size,median_time_ms,median_goodput_mbps,runs,failures')
+    for point in points:
+        res = summary.get(point, [])
+        fails = ' '.join(f'{k}={v}' for k, v in sorted(failures.get(point, {}).items()))
+        if res:
+            print(','.join(map(str, point)) + f',{statistics.median(t for t, _ in res):.3f},'
+                  f'{statistics.median(g for _, g in res):.3f},{len(res)},{fails}')
+        else:
+            print(','.join(map(str, point)) + f',,,0,{fails}')
+    return 0 if not failures else 1
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,305 @@
+#pragma once
+
+// congestion.hpp -- 可替换的拥塞控制
+// 发送端负责检测丢包（重复 ACK、SACK、超时）和重传，只把事件交给这里，由控制器决定窗口和发送速率：
+//   onAck          累计确认推进（不在快速恢复中），参数为新确认的报文段数
+//   onRttSample    一个 RTT 样本（毫秒，已按 Karn 算法过滤）
+//   onRateSample   一个报文段被确认（累计或 SACK）时的交付速率样本
+//   onLoss         三个重复 ACK，进入快速恢复
+//   onRecoveryDupAck / onRecoveryExit  快速恢复中的重复 ACK / 新 ACK 结束恢复
+//   onTimeout      一次超时事件
+// 窗口以报文段为单位；pacingRate 返回 0 时由发送端自己决定发送节奏
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "rdt.hpp"
+
+// 一个报文段被确认时的交付速率样本
+struct RateSample {
+    std::uint64_t delivered = 0;       // 确认这个报文段后累计交付的字节数
+    std::uint64_t priorDelivered = 0;  // 发送这个报文段时的累计交付字节数
+    double intervalMs = 0;             // 样本对应的时间区间
+    double rttMs = 0;                  // 该报文段的 RTT，重传过的为 0
+    std::uint32_t inFlight = 0;        // 当前在途字节数
+
+    double rate() const { return intervalMs > 0 ? (delivered - priorDelivered) / intervalMs : 0; }  // 字节/毫秒
+};
+
+class CongestionControl {
+public:
+    virtual ~CongestionControl() = default;
+
+    virtual const char* name() const = 0;
+    virtual double cwnd() const = 0;
+    virtual double ssthresh() const = 0;
+    virtual bool slowStart() const = 0;
+    virtual double pacingRate() const { return 0; }  // 字节/毫秒
+
+    virtual void onAck(int segs) = 0;
+    virtual void onRttSample(double) {}
+    virtual void onRateSample(const RateSample&) {}
+    virtual void onLoss() = 0;
+    virtual void onRecoveryDupAck() = 0;
+    virtual void onRecoveryExit() = 0;
+    virtual void onTimeout() = 0;
+};
+
+// ======================= 基于丢包的控制器 =======================
+// Reno 和 CUBIC 共用的部分：慢启动门限、快速恢复中的窗口膨胀与收缩
+class LossBasedControl : public CongestionControl {
+public:
+    double cwnd() const override { return cwnd_; }
+    double ssthresh() const override { return ssthresh_; }
+    bool slowStart() const override { return cwnd_ < ssthresh_; }
+
+    void onLoss() override {
+        ssthresh_ = std::max(cwnd_ * decrease(), 2.0);
+        cwnd_ = ssthresh_ + 3;
+    }
+    void onRecoveryDupAck() override { cwnd_ += 1.0; }
+    void onRecoveryExit() override { cwnd_ = ssthresh_; }
+    void onTimeout() override {
+        ssthresh_ = std::max(cwnd_ * decrease(), 2.0);
+        cwnd_ = 1.0;
+    }
+
+protected:
+    virtual double decrease() const = 0;  // 丢包后窗口乘的系数
+
+    double cwnd_ = 1.0;
+    double ssthresh_ = 64.0;
+};
+
+class RenoControl : public LossBasedControl {
+public:
+    const char* name() const override { return "reno"; }
+
+    void onAck(int segs) override {
+        if (slowStart()) cwnd_ += segs;
+        else cwnd_ += static_cast<double>(segs) / cwnd_;
+    }
+
+protected:
+    double decrease() const override { return 0.5; }
+};
+
+// CUBIC（RFC 8312）：拥塞避免阶段窗口是距上次丢包时间的三次函数，与 RTT 无关，
+// 在 W_max 附近放缓、远离时加速；同时估计同条件下 Reno 的窗口，取两者较大者
+class CubicControl : public LossBasedControl {
+public:
+    const char* name() const override { return "cubic"; }
+
+    void onRttSample(double rttMs) override {
+        if (minRtt_ == 0 || rttMs < minRtt_) minRtt_ = rttMs;
+    }
+
+    void onAck(int segs) override {
+        if (slowStart()) {
+            cwnd_ += segs;
+            return;
+        }
+        double now = nowSec();
+        if (epochStart_ < 0) {
+            epochStart_ = now;
+            k_ = wMax_ > cwnd_ ? std::cbrt((wMax_ - cwnd_) / C) : 0.0;
+            origin_ = std::max(wMax_, cwnd_);
+            wEst_ = cwnd_;
+        }
+        // 目标窗口取一个 RTT 之后的值
+        double t = now - epochStart_ + minRtt_ / 1000.0;
+        double target = origin_ + C * std::pow(t - k_, 3);
+        if (target > cwnd_) {
+            // 每个 RTT 最多增长到 1.5 倍
+            cwnd_ += std::min(target - cwnd_, 0.5 * cwnd_) / cwnd_ * segs;
+        } else {
+            cwnd_ += 0.01 * segs / cwnd_;
+        }
+        // TCP 友好区：按 Reno 的 AIMD（等效参数）估计窗口
+        wEst_ += 3 * (1 - BETA) / (1 + BETA) * segs / cwnd_;
+        cwnd_ = std::max(cwnd_, wEst_);
+    }
+
+    void onLoss() override {
+        startEpoch();
+        LossBasedControl::onLoss();
+    }
+
+    void onTimeout() override {
+        startEpoch();
+        LossBasedControl::onTimeout();
+    }
+
+protected:
+    double decrease() const override { return BETA; }
+
+private:
+    static constexpr double C = 0.4;
+    static constexpr double BETA = 0.7;
+
+    static double nowSec() {
+        return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // 记下丢包时的窗口；窗口还没长回上一次的 W_max 就又丢包时让出一部分（快速收敛）
+    void startEpoch() {
+        wMax_ = cwnd_ < wMax_ ? cwnd_ * (1 + BETA) / 2 : cwnd_;
+        epochStart_ = -1;
+    }
+
+    double wMax_ = 0;
+    double k_ = 0;
+    double origin_ = 0;
+    double wEst_ = 0;
+    double epochStart_ = -1;
+    double minRtt_ = 0;
+};
+
+// ======================= 基于速率的控制器 =======================
+// 仿 BBR：用交付速率的窗口最大值估计瓶颈带宽，用最小 RTT 估计传播时延，
+// 按两者乘积（BDP）设窗口、按带宽设发送速率，不把随机丢包当作拥塞信号。
+// ACK 成批到达（接收端批量应答、发送端批量读取）时，窗口另加上近期 ACK 聚合多确认的数据量，
+// 否则 BDP 只有几个报文段的本机回环上窗口会卡在下限。
+// 状态只有 STARTUP → DRAIN → PROBE_BW；传输时间通常远短于 10 s，省去了 PROBE_RTT
+class BbrControl : public CongestionControl {
+public:
+    const char* name() const override { return "bbr"; }
+    double cwnd() const override { return cwnd_; }
+    double ssthresh() const override { return 0; }
+    bool slowStart() const override { return mode_ == STARTUP; }
+    double pacingRate() const override { return pacingGain_ * btlBw_; }
+
+    void onAck(int) override {}
+    void onLoss() override {}
+    void onRecoveryDupAck() override {}
+    void onRecoveryExit() override {}
+    // 超时说明在途数据全部丢失，从最小窗口重新开始，模型保留
+    void onTimeout() override { cwnd_ = MIN_CWND; }
+
+    void onRttSample(double rttMs) override {
+        if (minRtt_ == 0 || rttMs < minRtt_) minRtt_ = rttMs;
+    }
+
+    void onRateSample(const RateSample& rs) override {
+        if (rs.rttMs > 0) onRttSample(rs.rttMs);
+
+        // 被确认的报文段是在上一轮结束后发出的，就开始新的一轮
+        bool roundStart = false;
+        if (rs.priorDelivered >= nextRoundDelivered_) {
+            nextRoundDelivered_ = rs.delivered;
+            ++round_;
+            roundStart = true;
+            bw_[round_ % BW_WINDOW_ROUNDS] = 0;
+            extraAcked_[round_ % BW_WINDOW_ROUNDS] = 0;
+        }
+        double r = rs.rate();
+        double& slot = bw_[round_ % BW_WINDOW_ROUNDS];
+        slot = std::max(slot, r);
+        btlBw_ = *std::max_element(bw_, bw_ + BW_WINDOW_ROUNDS);
+        updateAckAggregation(rs.delivered - deliveredPrev_);
+        deliveredPrev_ = rs.delivered;
+
+        if (roundStart) updateMode(rs.inFlight);
+        if (mode_ == DRAIN && rs.inFlight <= bdpBytes()) enterProbeBw();
+        if (mode_ == PROBE_BW) cycleGain();
+
+        // 每确认一个报文段窗口加一（类似慢启动），直到目标窗口
+        double extra = *std::max_element(extraAcked_, extraAcked_ + BW_WINDOW_ROUNDS);
+        double target = std::max(MIN_CWND, (cwndGain_ * bdpBytes() + extra) / MSS);
+        if (btlBw_ == 0 || minRtt_ == 0) cwnd_ += 1;
+        else cwnd_ = cwnd_ < target ? std::min(cwnd_ + 1, target) : target;
+    }
+
+private:
+    enum Mode { STARTUP, DRAIN, PROBE_BW };
+
+    static constexpr int BW_WINDOW_ROUNDS = 10;
+    static constexpr double HIGH_GAIN = 2.885;  // 2/ln2，每轮发送速率翻倍
+    static constexpr double MIN_CWND = 4;
+    static constexpr int CYCLE_LEN = 8;
+
+    static double nowMs() {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    double bdpBytes() const { return btlBw_ * minRtt_; }
+
+    // 从一段聚合开始起，确认的数据比按 btlBw 应确认的多出多少；回落到预期以下就重新开始一段
+    void updateAckAggregation(std::uint64_t acked) {
+        double now = nowMs();
+        double expected = btlBw_ * (now - aggStart_);
+        if (aggAcked_ <= expected) {
+            aggStart_ = now;
+            aggAcked_ = 0;
+            expected = 0;
+        }
+        aggAcked_ += acked;
+        double extra = std::min(aggAcked_ - expected, cwnd_ * MSS);
+        double& slot = extraAcked_[round_ % BW_WINDOW_ROUNDS];
+        slot = std::max(slot, extra);
+    }
+
+    // 连续三轮带宽增长不到 25% 视为管道已满
+    void updateMode(std::uint32_t inFlight) {
+        if (mode_ != STARTUP) return;
+        if (btlBw_ >= fullBw_ * 1.25) {
+            fullBw_ = btlBw_;
+            fullBwRounds_ = 0;
+            return;
+        }
+        if (++fullBwRounds_ < 3) return;
+        mode_ = DRAIN;
+        pacingGain_ = 1 / HIGH_GAIN;
+        cwndGain_ = HIGH_GAIN;
+        if (inFlight <= bdpBytes()) enterProbeBw();
+    }
+
+    void enterProbeBw() {
+        mode_ = PROBE_BW;
+        cwndGain_ = 2.0;
+        cycleIdx_ = 0;
+        cycleStart_ = nowMs();
+        pacingGain_ = CYCLE_GAIN[0];
+    }
+
+    // 每个最小 RTT 换一档增益：1.25 探测更多带宽，0.75 排空探测造成的排队，其余 1.0 巡航
+    void cycleGain() {
+        double now = nowMs();
+        if (now - cycleStart_ < minRtt_) return;
+        cycleStart_ = now;
+        cycleIdx_ = (cycleIdx_ + 1) % CYCLE_LEN;
+        pacingGain_ = CYCLE_GAIN[cycleIdx_];
+    }
+
+    static constexpr double CYCLE_GAIN[CYCLE_LEN] = { 1.25, 0.75, 1, 1, 1, 1, 1, 1 };
+
+    Mode mode_ = STARTUP;
+    double cwnd_ = INITIAL_WINDOW_SIZE;
+    double pacingGain_ = HIGH_GAIN;
+    double cwndGain_ = HIGH_GAIN;
+    double btlBw_ = 0;                       // 字节/毫秒
+    double bw_[BW_WINDOW_ROUNDS] = {};       // 最近若干轮各自的最大交付速率
+    double minRtt_ = 0;                      // 毫秒
+    std::uint64_t round_ = 0;
+    std::uint64_t nextRoundDelivered_ = 0;
+    double extraAcked_[BW_WINDOW_ROUNDS] = {};  // 最近若干轮各自的 ACK 聚合量（字节）
+    double aggStart_ = 0;
+    double aggAcked_ = 0;
+    std::uint64_t deliveredPrev_ = 0;
+    double fullBw_ = 0;
+    int fullBwRounds_ = 0;
+    int cycleIdx_ = 0;
+    double cycleStart_ = 0;
+};
+
+// 按名字创建控制器，无法识别时返回空
+inline std::unique_ptr<CongestionControl> makeCongestionControl(const std::string& name) {
+    if (name == "reno") return std::unique_ptr<CongestionControl>(new RenoControl);
+    if (name == "cubic") return std::unique_ptr<CongestionControl>(new CubicControl);
+    if (name == "bbr") return std::unique_ptr<CongestionControl>(new BbrControl);
+    return nullptr;
+}
@@ -34,4 +34,25 @@ plt.tight_layout()
 plt.savefig('loss_vs_time.png', dpi=300)
 plt.close()
 
-print("两张图已生成：wnd_vs_time.png 和 loss_vs_time.png")
\ No newline at end of file
+# ---------- 图3：不同拥塞控制在各丢包率下的传输时间 ----------
+# sender --cc reno|cubic|bbr --io mmsg，receiver --window 1024，本机回环，每点取 5 次的中位数
+time_cc = {
+    'Reno':  [22, 39, 80, 172, 278, 535, 890],
+    'CUBIC': [23, 24, 76, 84, 159, 440, 1039],
+    'BBR':   [29, 35, 48, 71, 81, 123, 180],
+}
+
+plt.figure()
+for (name, times), color in zip(time_cc.items(), ['red', 'green', 'blue']):
+    plt.plot(loss, times, marker='o', color=color, label=name)
+plt.xlabel('Loss rate')
+plt.ylabel('Transfer time (ms)')
+plt.title('Congestion control vs loss rate (rwnd=1024)')
+plt.xticks(loss, labels=[f'{100*x:g}%' for x in loss])
+plt.legend()
+plt.grid(True)
+plt.tight_layout()
+plt.savefig('cc_vs_loss.png', dpi=300)
+plt.close()
+
+print("三张图已生成：wnd_vs_time.png、loss_vs_time.png 和 cc_vs_loss.png")
\ No newline at end of file
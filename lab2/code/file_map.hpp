@@ -0,0 +1,146 @@
+#pragma once
+
+// file_map.hpp -- 零拷贝文件读写
+// MappedFile   ：把输入文件只读映射进内存，发送端的报文段直接指向映射区，重传时也从这里取数据
+// OffsetFileSink：按偏移写文件（pwrite / 带 OVERLAPPED 偏移的 WriteFile），
+//                接收端每个报文段一到就写到它在文件中的位置，不必先缓存再按序写出
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "net_compat.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+class MappedFile {
+public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // 空文件也算打开成功，此时 data() 为空
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                            FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (file_ == INVALID_HANDLE_VALUE) return false;
+        LARGE_INTEGER sz;
+        if (!GetFileSizeEx(file_, &sz)) return false;
+        size_ = static_cast<std::size_t>(sz.QuadPart);
+        if (size_ == 0) return true;
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (!mapping_) return false;
+        data_ = static_cast<const char*>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0));
+        return data_ != nullptr;
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            ::close(fd);
+            return false;
+        }
+        size_ = static_cast<std::size_t>(st.st_size);
+        if (size_ > 0) {
+            void* p = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED) {
+                data_ = static_cast<const char*>(p);
+                madvise(p, size_, MADV_SEQUENTIAL);  // 预读，发送时少缺页
+            }
+        }
+        ::close(fd);  // 映射不依赖文件描述符
+        return size_ == 0 || data_ != nullptr;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_) UnmapViewOfFile(data_);
+        if (mapping_) CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_) munmap(const_cast<char*>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const char* data() const { return data_; }
+    std::size_t size() const { return size_; }
+
+private:
+    const char* data_ = nullptr;
+    std::size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+class OffsetFileSink {
+public:
+    OffsetFileSink() = default;
+    ~OffsetFileSink() { close(); }
+
+    OffsetFileSink(const OffsetFileSink&) = delete;
+    OffsetFileSink& operator=(const OffsetFileSink&) = delete;
+
+    // 创建或清空文件
+    bool open(const std::string& path) {
+        close();
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        return file_ != INVALID_HANDLE_VALUE;
+#else
+        fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        return fd_ >= 0;
+#endif
+    }
+
+    // 把 len 字节写到 offset 处，中间的空洞由之后到达的报文段填上
+    bool write(std::uint64_t offset, const char* data, std::size_t len) {
+#ifdef _WIN32
+        OVERLAPPED ov{};
+        ov.Offset = static_cast<DWORD>(offset);
+        ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD done = 0;
+        return WriteFile(file_, data, static_cast<DWORD>(len), &done, &ov) && done == len;
+#else
+        while (len > 0) {
+            ssize_t n = pwrite(fd_, data, len, static_cast<off_t>(offset));
+            if (n <= 0) return false;
+            data += n;
+            offset += static_cast<std::uint64_t>(n);
+            len -= static_cast<std::size_t>(n);
+        }
+        return true;
+#endif
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (file_ != INVALID_HANDLE_VALUE) CloseHandle(file_);
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (fd_ >= 0) ::close(fd_);
+        fd_ = -1;
+#endif
+    }
+
+private:
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+#else
+    int fd_ = -1;
+#endif
+};
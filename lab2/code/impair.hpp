@@ -0,0 +1,139 @@
+#pragma once
+
+// impair.hpp -- 单方向链路损伤模型，供 impair_proxy 使用
+// 每个报文依次经过：
+//   丢包      Bernoulli 独立丢包，和/或 Gilbert-Elliott 两状态突发丢包
+//   瓶颈      令牌桶限速，排队超过队列上限的报文尾部丢弃
+//   损坏      随机翻转一个比特（接收端校验和应能发现）
+//   复制      同一报文多发一份
+//   时延      固定时延 + 均匀抖动，部分报文额外滞留一段时间造成乱序（抖动本身也可能乱序）
+// 时间由调用方传入（毫秒），模型本身不读时钟，同样的种子和到达序列得到同样的结果
+
+#include <algorithm>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ImpairConfig {
+    double loss = 0;           // Bernoulli 丢包率
+    // Gilbert-Elliott：好状态下每个报文以 geP 进入坏状态，坏状态下以 geR 回到好状态，
+    // 两个状态的丢包率分别为 geLossGood / geLossBad；geP 为 0 时不启用
+    double geP = 0;
+    double geR = 1;
+    double geLossGood = 0;
+    double geLossBad = 1;
+    double delayMs = 0;        // 固定单向时延
+    double jitterMs = 0;       // 时延在 [-jitter, +jitter] 内均匀抖动
+    double reorder = 0;        // 报文被额外滞留的概率
+    double reorderMs = 5;      // 额外滞留时长，之后到达的报文会先于它交付
+    double dup = 0;            // 复制概率
+    double corrupt = 0;        // 损坏概率
+    double rateMbps = 0;       // 瓶颈带宽，0 表示不限速
+    std::uint32_t burstBytes = 16 * 1024;    // 令牌桶容量
+    std::uint32_t queueBytes = 256 * 1024;   // 瓶颈队列上限
+
+    bool active() const {
+        return loss > 0 || geP > 0 || delayMs > 0 || jitterMs > 0 || reorder > 0 || dup > 0 ||
+               corrupt > 0 || rateMbps > 0;
+    }
+};
+
+struct ImpairStats {
+    std::uint64_t in = 0;
+    std::uint64_t lost = 0;       // 随机丢包（Bernoulli + Gilbert-Elliott）
+    std::uint64_t overflow = 0;   // 瓶颈队列溢出
+    std::uint64_t corrupted = 0;
+    std::uint64_t duplicated = 0;
+    std::uint64_t reordered = 0;
+    std::uint64_t out = 0;
+    std::uint64_t bytesOut = 0;
+};
+
+class Impairment {
+public:
+    Impairment(const ImpairConfig& c, std::uint32_t seed) : c_(c), rng_(seed) {
+        tokens_ = c_.burstBytes;
+    }
+
+    // 处理 nowMs 时刻到达的一个报文，对每个要发出的副本调用 emit(发出时刻, 数据)。
+    // 数据可能被就地改写（损坏）
+    template <class F>
+    void process(double nowMs, std::vector<char>& pkt, F&& emit) {
+        ++st_.in;
+        if (dropRandom()) {
+            ++st_.lost;
+            return;
+        }
+
+        double depart = nowMs;
+        if (c_.rateMbps > 0 && !shape(nowMs, pkt.size(), depart)) {
+            ++st_.overflow;
+            return;
+        }
+
+        if (chance(c_.corrupt) && !pkt.empty()) {
+            std::size_t byte = std::uniform_int_distribution<std::size_t>(0, pkt.size() - 1)(rng_);
+            pkt[byte] ^= static_cast<char>(1u << std::uniform_int_distribution<int>(0, 7)(rng_));
+            ++st_.corrupted;
+        }
+
+        int copies = 1;
+        if (chance(c_.dup)) {
+            ++copies;
+            ++st_.duplicated;
+        }
+        for (int i = 0; i < copies; ++i) {
+            double at = depart + c_.delayMs;
+            if (c_.jitterMs > 0) at += std::uniform_real_distribution<double>(-c_.jitterMs, c_.jitterMs)(rng_);
+            if (chance(c_.reorder)) {
+                at += c_.reorderMs;
+                ++st_.reordered;
+            }
+            ++st_.out;
+            st_.bytesOut += pkt.size();
+            emit(std::max(at, nowMs), pkt);
+        }
+    }
+
+    const ImpairStats& stats() const { return st_; }
+    void resetStats() { st_ = ImpairStats{}; }
+
+private:
+    bool chance(double p) { return p > 0 && uni_(rng_) < p; }
+
+    bool dropRandom() {
+        bool drop = chance(c_.loss);
+        if (c_.geP > 0) {
+            // 先转移状态，再按所在状态的丢包率决定
+            bad_ = bad_ ? !chance(c_.geR) : chance(c_.geP);
+            drop = chance(bad_ ? c_.geLossBad : c_.geLossGood) || drop;
+        }
+        return drop;
+    }
+
+    // 令牌桶按到达顺序逐个放行：令牌不够时等到攒够为止，等待的报文构成瓶颈队列。
+    // 不真正维护队列，只记下最后一个报文的放行时刻，积压量由它换算
+    bool shape(double nowMs, std::size_t len, double& depart) {
+        double rate = c_.rateMbps * 125.0;  // 字节/毫秒
+        double start = std::max(nowMs, lastDepart_);
+        if ((start - nowMs) * rate + len > c_.queueBytes) return false;
+
+        tokens_ = std::min<double>(c_.burstBytes, tokens_ + (start - tokTime_) * rate);
+        depart = tokens_ >= len ? start : start + (len - tokens_) / rate;
+        tokens_ = std::max(0.0, tokens_ - len + (depart - start) * rate);
+        tokTime_ = depart;
+        lastDepart_ = depart;
+        return true;
+    }
+
+    ImpairConfig c_;
+    std::mt19937 rng_;
+    std::uniform_real_distribution<double> uni_{0.0, 1.0};
+    ImpairStats st_;
+    bool bad_ = false;          // Gilbert-Elliott 当前状态
+    double tokens_ = 0;
+    double tokTime_ = 0;
+    double lastDepart_ = 0;
+};
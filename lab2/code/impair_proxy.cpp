@@ -0,0 +1,243 @@
+// impair_proxy.cpp  ——  UDP 链路损伤中继：放在发送端和接收端之间，按方向施加丢包、时延、乱序、复制、损坏和限速
+// 编译：cl /std:c++17 /EHsc impair_proxy.cpp ws2_32.lib
+// Linux：g++ -std=c++17 -O2 -Wall -Wextra -o impair_proxy impair_proxy.cpp
+// 用法：impair_proxy [--listen N] [--host IP] [--port N] [--seed N] [--quiet] [损伤参数...]
+//   损伤参数写成 --KEY V 时两个方向都生效，--fwd-KEY V 只作用于发送端→接收端，--rev-KEY V 只作用于反方向。
+//   KEY：loss P | ge-p P | ge-r P | ge-good P | ge-bad P | delay MS | jitter MS | reorder P | reorder-gap MS
+//        dup P | corrupt P | rate MBPS | burst BYTES | queue BYTES
+// 例：impair_proxy --listen 6001 --port 6000 --fwd-loss 0.02 --delay 10 --jitter 2 --fwd-rate 50
+//     sender --port 6001，receiver --loss 0
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "rdt.hpp"
+#include "impair.hpp"
+
+using std::cout;
+using std::endl;
+using std::string;
+
+// ---------- 配置 ----------
+namespace cfg {
+constexpr uint16_t LISTEN_PORT = RDT_PORT + 1;   // 发送端改连这个端口
+constexpr unsigned IDLE_MS     = 1000;           // 空闲这么久视为一次传输结束，打印统计
+constexpr int      MAX_DGRAM   = 65536;
+}
+
+using clock_type = std::chrono::steady_clock;
+
+enum Dir { FWD = 0, REV = 1 };   // FWD：发送端→接收端，REV：接收端→发送端
+
+struct Options {
+    uint16_t     listen = cfg::LISTEN_PORT;
+    string       host   = "127.0.0.1";   // 接收端地址
+    uint16_t     port   = RDT_PORT;
+    uint32_t     seed   = 1;
+    ImpairConfig dir[2];
+    bool         quiet  = false;
+};
+
+// 等待发出的报文，按发出时刻排序，同一时刻按进入顺序
+struct Scheduled {
+    double      at;
+    uint64_t    order;
+    Dir         dir;
+    std::vector<char> data;
+
+    bool operator>(const Scheduled& o) const { return at != o.at ? at > o.at : order > o.order; }
+};
+
+// ---------- 全局状态 ----------
+namespace proxy {
+Options opt;
+SOCKET front = INVALID_SOCKET;   // 面向发送端，绑定在 listen 端口
+SOCKET back = INVALID_SOCKET;    // 面向接收端，临时端口
+sockaddr_in client{};            // 最近一次发来报文的发送端地址
+sockaddr_in server{};
+bool haveClient = false;
+clock_type::time_point t0;
+std::priority_queue<Scheduled, std::vector<Scheduled>, std::greater<Scheduled>> pending;
+uint64_t order = 0;
+}
+
+inline void logInfo(const string& s) { cout << "[PROXY] " << s << endl; }
+
+inline double nowMs() {
+    return std::chrono::duration<double, std::milli>(clock_type::now() - proxy::t0).count();
+}
+
+// ---------- 命令行 ----------
+bool setImpair(ImpairConfig& c, const string& key, const char* val) {
+    double v = std::atof(val);
+    if      (key == "loss")        c.loss = v;
+    else if (key == "ge-p")        c.geP = v;
+    else if (key == "ge-r")        c.geR = v;
+    else if (key == "ge-good")     c.geLossGood = v;
+    else if (key == "ge-bad")      c.geLossBad = v;
+    else if (key == "delay")       c.delayMs = v;
+    else if (key == "jitter")      c.jitterMs = v;
+    else if (key == "reorder")     c.reorder = v;
+    else if (key == "reorder-gap") c.reorderMs = v;
+    else if (key == "dup")         c.dup = v;
+    else if (key == "corrupt")     c.corrupt = v;
+    else if (key == "rate")        c.rateMbps = v;
+    else if (key == "burst")       c.burstBytes = static_cast<uint32_t>(v);
+    else if (key == "queue")       c.queueBytes = static_cast<uint32_t>(v);
+    else return false;
+    return true;
+}
+
+bool parseArgs(int argc, char** argv, Options& o) {
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        bool hasVal = i + 1 < argc;
+        if (a == "--listen" && hasVal) {
+            o.listen = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (a == "--host" && hasVal) {
+            o.host = argv[++i];
+        } else if (a == "--port" && hasVal) {
+            o.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (a == "--seed" && hasVal) {
+            o.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (a == "--quiet") {
+            o.quiet = true;
+        } else if (a.compare(0, 6, "--fwd-") == 0 && hasVal) {
+            if (!setImpair(o.dir[FWD], a.substr(6), argv[++i])) return false;
+        } else if (a.compare(0, 6, "--rev-") == 0 && hasVal) {
+            if (!setImpair(o.dir[REV], a.substr(6), argv[++i])) return false;
+        } else if (a.compare(0, 2, "--") == 0 && hasVal) {
+            const char* v = argv[++i];
+            if (!setImpair(o.dir[FWD], a.substr(2), v) || !setImpair(o.dir[REV], a.substr(2), v)) return false;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---------- 转发 ----------
+void transmit(const Scheduled& s) {
+    if (s.dir == FWD) {
+        sendto(proxy::back, s.data.data(), static_cast<int>(s.data.size()), 0,
+               reinterpret_cast<const sockaddr*>(&proxy::server), sizeof(proxy::server));
+    } else if (proxy::haveClient) {
+        sendto(proxy::front, s.data.data(), static_cast<int>(s.data.size()), 0,
+               reinterpret_cast<const sockaddr*>(&proxy::client), sizeof(proxy::client));
+    }
+}
+
+void printStats(Impairment* link) {
+    static const char* names[2] = { "fwd", "rev" };
+    for (int d = 0; d < 2; ++d) {
+        const ImpairStats& s = link[d].stats();
+        logInfo(string(names[d]) + ": in " + std::to_string(s.in) + ", lost " + std::to_string(s.lost) +
+                ", overflow " + std::to_string(s.overflow) + ", corrupted " + std::to_string(s.corrupted) +
+                ", duplicated " + std::to_string(s.duplicated) + ", reordered " + std::to_string(s.reordered) +
+                ", out " + std::to_string(s.out) + " (" + std::to_string(s.bytesOut) + " B)");
+        link[d].resetStats();
+    }
+}
+
+int main(int argc, char** argv) {
+#ifdef _WIN32
+    // 设置控制台输出编码为 UTF-8
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+    if (!parseArgs(argc, argv, proxy::opt)) {
+        std::cerr << "usage: impair_proxy [--listen N] [--host IP] [--port N] [--seed N] [--quiet] "
+                     "[--[fwd-|rev-]KEY V ...]\n"
+                     "  KEY: loss ge-p ge-r ge-good ge-bad delay jitter reorder reorder-gap dup corrupt rate burst queue\n";
+        return 2;
+    }
+    if (!net_startup()) return 1;
+
+    proxy::front = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    proxy::back = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (proxy::front == INVALID_SOCKET || proxy::back == INVALID_SOCKET) return 1;
+
+    // 限速排队在进程内完成，套接字缓冲区只需吸收突发
+    int buf = 4 * 1024 * 1024;
+    for (SOCKET s : { proxy::front, proxy::back }) {
+        setsockopt(s, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<char*>(&buf), sizeof(buf));
+        setsockopt(s, SOL_SOCKET, SO_SNDBUF, reinterpret_cast<char*>(&buf), sizeof(buf));
+    }
+
+    sockaddr_in local{};
+    local.sin_family      = AF_INET;
+    local.sin_port        = htons(proxy::opt.listen);
+    local.sin_addr.s_addr = INADDR_ANY;
+    if (bind(proxy::front, reinterpret_cast<sockaddr*>(&local), sizeof(local)) == SOCKET_ERROR) {
+        closesocket(proxy::front); closesocket(proxy::back); net_cleanup(); return 1;
+    }
+
+    proxy::server.sin_family = AF_INET;
+    proxy::server.sin_port   = htons(proxy::opt.port);
+    inet_pton(AF_INET, proxy::opt.host.c_str(), &proxy::server.sin_addr);
+
+    // 两个方向各用一个随机数发生器，一个方向的参数变化不影响另一个方向的随机序列
+    Impairment link[2] = { Impairment(proxy::opt.dir[FWD], proxy::opt.seed),
+                           Impairment(proxy::opt.dir[REV], proxy::opt.seed + 0x9E3779B9u) };
+
+    logInfo("Relaying :" + std::to_string(proxy::opt.listen) + " -> " + proxy::opt.host + ":" +
+            std::to_string(proxy::opt.port) + ", seed " + std::to_string(proxy::opt.seed));
+
+    proxy::t0 = clock_type::now();
+    std::vector<char> rxBuf(cfg::MAX_DGRAM);
+    double lastActive = 0;
+    bool active = false;
+    for (;;) {
+        // 到点的报文先发出去，再等下一个报文到达或下一个发出时刻
+        double now = nowMs();
+        while (!proxy::pending.empty() && proxy::pending.top().at <= now) {
+            transmit(proxy::pending.top());
+            proxy::pending.pop();
+        }
+
+        if (active && proxy::pending.empty() && now - lastActive >= cfg::IDLE_MS) {
+            if (!proxy::opt.quiet) logInfo("Idle, transfer finished");
+            printStats(link);
+            active = false;
+        }
+
+        double waitMs = proxy::pending.empty() ? cfg::IDLE_MS : proxy::pending.top().at - now;
+        timeval tv{ static_cast<long>(waitMs / 1000),
+                    static_cast<decltype(tv.tv_usec)>(std::fmod(waitMs, 1000.0) * 1000) };
+        fd_set rd;
+        FD_ZERO(&rd);
+        FD_SET(proxy::front, &rd);
+        FD_SET(proxy::back, &rd);
+        int nfds = static_cast<int>(std::max(proxy::front, proxy::back)) + 1;  // Windows 忽略此参数
+        if (select(nfds, &rd, nullptr, nullptr, &tv) <= 0) continue;
+
+        for (Dir d : { FWD, REV }) {
+            SOCKET s = d == FWD ? proxy::front : proxy::back;
+            if (!FD_ISSET(s, &rd)) continue;
+
+            sockaddr_in from{};
+            socklen_t fromLen = sizeof(from);
+            int n = recvfrom(s, rxBuf.data(), cfg::MAX_DGRAM, 0, reinterpret_cast<sockaddr*>(&from), &fromLen);
+            if (n <= 0) continue;
+            if (d == FWD) {
+                proxy::client = from;
+                proxy::haveClient = true;
+            }
+
+            now = nowMs();
+            lastActive = now;
+            active = true;
+            std::vector<char> pkt(rxBuf.begin(), rxBuf.begin() + n);
+            link[d].process(now, pkt, [&](double at, const std::vector<char>& data) {
+                proxy::pending.push(Scheduled{ at, proxy::order++, d, data });
+            });
+        }
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+// net_compat.hpp -- 跨平台套接字适配：Windows 下使用 Winsock2，Linux 下映射到 BSD socket，
+// 让 sender/receiver 的同一份代码在两边都能编译
+
+#ifdef _WIN32
+
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef _WINSOCK_DEPRECATED_NO_WARNINGS
+#define _WINSOCK_DEPRECATED_NO_WARNINGS
+#endif
+#ifndef _CRT_SECURE_NO_WARNINGS
+#define _CRT_SECURE_NO_WARNINGS
+#endif
+#ifndef _WIN32_WINNT
+#define _WIN32_WINNT 0x0600  // 为了使用 inet_pton
+#endif
+
+#include <winsock2.h>  // 必须放在 windows.h 前面
+#include <ws2tcpip.h>
+#include <windows.h>
+
+#pragma comment(lib, "ws2_32.lib")
+
+#else
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+typedef int SOCKET;
+
+#define INVALID_SOCKET (-1)
+#define SOCKET_ERROR   (-1)
+
+inline int closesocket(SOCKET s) { return close(s); }
+
+#endif
+
+// 初始化网络库：Windows 需要 WSAStartup
+inline bool net_startup() {
+#ifdef _WIN32
+    WSADATA wsa;
+    return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+#else
+    return true;
+#endif
+}
+
+inline void net_cleanup() {
+#ifdef _WIN32
+    WSACleanup();
+#endif
+}
+
+// 设置接收超时，阻塞的 recvfrom 最多等待 ms 毫秒，便于线程检查退出标志
+inline void set_recv_timeout(SOCKET s, unsigned ms) {
+#ifdef _WIN32
+    DWORD tv = ms;
+#else
+    timeval tv{ static_cast<time_t>(ms / 1000), static_cast<suseconds_t>((ms % 1000) * 1000) };
+#endif
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&tv), sizeof(tv));
+}
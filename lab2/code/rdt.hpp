@@ -1,17 +1,19 @@
 #pragma once
 
-#define WIN32_LEAN_AND_MEAN
-#define _WINSOCK_DEPRECATED_NO_WARNINGS
-#define _CRT_SECURE_NO_WARNINGS
-
 #include <cstdint>
-#include <winsock2.h>
-#include <windows.h>
+#include <cstring>
+
+#include "net_compat.hpp"
 
 // ======================= 常量定义 =======================
-#define MSS 1024                // 最大报文段长度
+#ifndef MSS
+#define MSS 1024                // 最大报文段长度，可在编译时用 -DMSS=N 覆盖（两端必须一致）
+#endif
+static_assert(MSS > 0 && MSS <= 8192, "MSS must fit in one UDP datagram and the 16-bit data_len");
 #define RDT_PORT 6000           // 传输端口
-#define TIMEOUT_MS 500          // 重传超时时间（毫秒）
+#define TIMEOUT_MS 500          // 初始重传超时（毫秒），有 RTT 样本后按估计值调整
+#define RTO_MIN_MS 5            // 重传超时下限（毫秒）
+#define RTO_MAX_MS 4000         // 重传超时上限，指数退避不超过此值
 #define INITIAL_WINDOW_SIZE 4   // 初始窗口大小（报文段数量）
 
 // ======================= 报文类型定义 =======================
@@ -21,10 +23,20 @@ enum class PacketType : std::uint8_t {
     DATA = 2,       // 数据传输报文
     ACK = 3,        // 确认报文（累计ACK + SACK Mask）
     FIN = 4,        // 连接终止请求
-    FIN_ACK = 5     // 连接终止确认
+    FIN_ACK = 5,    // 连接终止确认
+    PROBE = 6       // 零窗口探测，不带数据、不占序号，接收方回一个带当前窗口的 ACK
 };
 
+// ======================= 线上格式 =======================
+// 报文 = 24 字节头部 + data_len 字节数据，多字节字段一律大端，逐字节读写，与结构体布局和填充无关：
+//   0 type | 1 flags | 2-3 checksum | 4-5 data_len | 6-7 保留 | 8-11 seq_num | 12-15 ack_num
+//   16-19 win_size | 20-23 sack_mask | 24.. payload
+// 校验和是头部（校验和字段按 0 计）加实际数据的 16 位反码和，ACK 等控制报文只有 24 字节
+#define RDT_HEADER_LEN 24
+#define RDT_MAX_PACKET (RDT_HEADER_LEN + MSS)
+
 // ======================= RDT 报文结构 =======================
+// 内存中的报文，字段为主机字节序；收发时经 RdtProtocolHelper 与线上格式互相转换
 class RdtPacket {
 public:
     std::uint8_t type;       // 报文类型
@@ -40,33 +52,105 @@ public:
 // ======================= 工具类 =======================
 class RdtProtocolHelper {
 public:
+    // 按大端 16 位字求反码和，奇数长度时末字节补 0；不要求 buf 对齐
     static std::uint16_t calculateChecksum(const char* buf, int len) {
-        std::uint32_t sum = 0;
-        const std::uint16_t* ptr = reinterpret_cast<const std::uint16_t*>(buf);
+        return fold(sumWords(buf, len, 0));
+    }
+
+    // 头部和数据不相邻时分两段求和；头部长度为偶数，两段的 16 位字边界一致
+    static std::uint16_t calculateChecksum(const char* hdr, const char* payload, int payloadLen) {
+        return fold(sumWords(payload, payloadLen, sumWords(hdr, RDT_HEADER_LEN, 0)));
+    }
+
+    // 数据已经放在 out + RDT_HEADER_LEN 处时，只写头部并计算校验和，返回报文总长度
+    static int writeHeader(const RdtPacket& p, char* out) {
+        return writeHeader(p, out, out + RDT_HEADER_LEN);
+    }
+
+    // 数据在别处（例如映射的文件）时，把 RDT_HEADER_LEN 字节的头部写到 hdr，校验和覆盖 payload，
+    // 发送时头部和数据分成两段交给内核拼接，返回报文总长度
+    static int writeHeader(const RdtPacket& p, char* hdr, const char* payload) {
+        hdr[0] = static_cast<char>(p.type);
+        hdr[1] = 0;
+        putU16(hdr + 2, 0);
+        putU16(hdr + 4, p.data_len);
+        putU16(hdr + 6, 0);
+        putU32(hdr + 8, p.seq_num);
+        putU32(hdr + 12, p.ack_num);
+        putU32(hdr + 16, p.win_size);
+        putU32(hdr + 20, p.sack_mask);
+        putU16(hdr + 2, calculateChecksum(hdr, payload, p.data_len));
+        return RDT_HEADER_LEN + p.data_len;
+    }
+
+    // 编码为线上格式（out 至少 RDT_MAX_PACKET 字节），返回报文总长度
+    static int encode(const RdtPacket& p, char* out) {
+        std::memcpy(out + RDT_HEADER_LEN, p.payload, p.data_len);
+        return writeHeader(p, out);
+    }
+
+    // 解析收到的 len 字节：长度不符或校验和错误时返回 false
+    static bool decode(const char* buf, int len, RdtPacket& out) {
+        if (!decodeHeader(buf, len, out)) return false;
+        std::memcpy(out.payload, buf + RDT_HEADER_LEN, out.data_len);
+        return true;
+    }
+
+    // 只校验并解析头部，不拷贝数据，数据就在 buf + RDT_HEADER_LEN 处
+    static bool decodeHeader(const char* buf, int len, RdtPacket& out) {
+        if (len < RDT_HEADER_LEN) return false;
+        std::uint16_t dataLen = getU16(buf + 4);
+        if (dataLen > MSS || len != RDT_HEADER_LEN + dataLen) return false;
+        // 含校验和字段一起求和，结果为全 1 时取反得 0
+        if (calculateChecksum(buf, len) != 0) return false;
+        out.type = static_cast<std::uint8_t>(buf[0]);
+        out.checksum = getU16(buf + 2);
+        out.data_len = dataLen;
+        out.seq_num = getU32(buf + 8);
+        out.ack_num = getU32(buf + 12);
+        out.win_size = getU32(buf + 16);
+        out.sack_mask = getU32(buf + 20);
+        return true;
+    }
+
+private:
+    // 累加大端 16 位字，不折叠进位
+    static std::uint32_t sumWords(const char* buf, int len, std::uint32_t sum) {
+        const unsigned char* p = reinterpret_cast<const unsigned char*>(buf);
         while (len > 1) {
-            sum += *ptr++;
+            sum += (static_cast<std::uint32_t>(p[0]) << 8) | p[1];
+            p += 2;
             len -= 2;
         }
         if (len == 1) {
-            sum += *reinterpret_cast<const std::uint8_t*>(ptr);
+            sum += static_cast<std::uint32_t>(p[0]) << 8;
         }
+        return sum;
+    }
+    static std::uint16_t fold(std::uint32_t sum) {
         while (sum >> 16) {
             sum = (sum & 0xFFFF) + (sum >> 16);
         }
         return static_cast<std::uint16_t>(~sum);
     }
 
-    static bool isChecksumValid(const RdtPacket& packet) {
-        RdtPacket temp = packet;
-        temp.checksum = 0;
-        std::uint16_t calculated = calculateChecksum(
-            reinterpret_cast<const char*>(&temp), sizeof(RdtPacket));
-        return packet.checksum == calculated;
+    static void putU16(char* p, std::uint16_t v) {
+        p[0] = static_cast<char>(v >> 8);
+        p[1] = static_cast<char>(v);
     }
-
-    static void setChecksum(RdtPacket& packet) {
-        packet.checksum = 0;
-        packet.checksum = calculateChecksum(
-            reinterpret_cast<const char*>(&packet), sizeof(RdtPacket));
+    static void putU32(char* p, std::uint32_t v) {
+        p[0] = static_cast<char>(v >> 24);
+        p[1] = static_cast<char>(v >> 16);
+        p[2] = static_cast<char>(v >> 8);
+        p[3] = static_cast<char>(v);
+    }
+    static std::uint16_t getU16(const char* p) {
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+        return static_cast<std::uint16_t>((u[0] << 8) | u[1]);
+    }
+    static std::uint32_t getU32(const char* p) {
+        const unsigned char* u = reinterpret_cast<const unsigned char*>(p);
+        return (static_cast<std::uint32_t>(u[0]) << 24) | (static_cast<std::uint32_t>(u[1]) << 16) |
+               (static_cast<std::uint32_t>(u[2]) << 8) | u[3];
     }
 };
\ No newline at end of file
@@ -1,22 +1,23 @@
 // receiver.cpp  ——  RDT Receiver (UDP + SR + SACK + 模拟丢包)
 // 编译：cl /std:c++17 /EHsc receiver.cpp ws2_32.lib
+// Linux：g++ -std=c++17 -O2 -Wall -Wextra -o receiver receiver.cpp
+// 用法：receiver [--io plain|mmsg|gso] [--loss P] [--seed N] [--window N] [--app-rate MBps] [--port N] [--out PATH] [--quiet]
 
-#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#include <windows.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#pragma comment(lib, "ws2_32.lib")
-
+#include <cstddef>
 #include <cstdint>
+#include <chrono>
+#include <cstdlib>
 #include <iostream>
-#include <fstream>
-#include <map>
+#include <memory>
 #include <string>
 #include <random>
 #include <ctime>
+#include <vector>
 
 #include "rdt.hpp"
+#include "seq_ring.hpp"
+#include "batch_io.hpp"
+#include "file_map.hpp"
 
 using std::cout;
 using std::endl;
@@ -26,50 +27,86 @@ using std::string;
 namespace cfg {
 constexpr const char* OUTPUT_FILE     = "output.jpg";
 constexpr double      PACKET_LOSS_RATE= 0.10;          // 10% 丢包
-constexpr uint32_t    RECV_WIN_PKTS   = INITIAL_WINDOW_SIZE;
+constexpr uint32_t    RECV_WIN_PKTS   = 16384;         // 接收缓冲区 16 MB（报文段数）
+constexpr unsigned    LINGER_MS       = 500;           // 回 FIN_ACK 后继续应答重发的 FIN 的时长
+constexpr unsigned    APP_TICK_MS     = 2;             // 限速读取时检查缓冲区的间隔
 }
 
-// ---------- 日志 ----------
-inline void logInfo(const string& s) { cout << "[RECV] " << s << endl; }
+using clock_type = std::chrono::steady_clock;
 
-// ---------- RAII 锁 ----------
-struct Lock {
-    CRITICAL_SECTION& cs_;
-    explicit Lock(CRITICAL_SECTION& cs) : cs_(cs) { EnterCriticalSection(&cs_); }
-    ~Lock() { LeaveCriticalSection(&cs_); }
+// 命令行参数，默认值见 cfg
+struct Options {
+    uint16_t    port    = RDT_PORT;
+    string      file    = cfg::OUTPUT_FILE;
+    double      loss    = cfg::PACKET_LOSS_RATE;
+    uint32_t    seed    = 0;        // 丢包随机种子，0 表示按当前时间
+    uint32_t    winPkts = cfg::RECV_WIN_PKTS;
+    double      appRate = 0;        // 模拟应用读取速度（MB/s），0 表示到达即读走
+    IoMode      io      = IoMode::Plain;
+    bool        quiet   = false;    // 不打印逐个报文的日志
 };
 
+// ---------- 日志 ----------
+inline void logInfo(const string& s) { cout << "[RECV] " << s << endl; }
+
 // ---------- 全局状态 ----------
 namespace receiver {
 SOCKET sock;
 sockaddr_in peerAddr{};
-int addrLen = sizeof(peerAddr);
-
-CRITICAL_SECTION csSR;
+socklen_t addrLen = sizeof(peerAddr);
+Options opt;
 
-// 接收窗口
+// 接收窗口：缓冲区里是已按序到达、应用还没读走的数据，空闲部分就是通告的窗口
 uint32_t baseSeq = 0;                       // 期望序号
-uint32_t winSize = cfg::RECV_WIN_PKTS * MSS;// 字节数
+uint32_t bufBytes = cfg::RECV_WIN_PKTS * MSS;
+uint32_t rightEdge = 0;                     // 已通告的窗口右沿（baseSeq + 窗口），只前移不后退
+double unread = 0;                          // 应用还没读走的字节
+clock_type::time_point lastRead;
+bool closed = false;                        // 最近一次通告的窗口不足一个 MSS
+uint64_t zeroWindows = 0;
+uint64_t probes = 0;
+uint64_t windowUpdates = 0;
 
-// 乱序缓存 <seqNum, RdtPacket>
-std::map<uint32_t, RdtPacket> buf;
+// 窗口内已收到的报文段，按序号索引，只记长度；数据到达时已写进文件。
+// 容量不小于接收窗口（窗口大小由命令行决定，在 main 中创建）
+std::unique_ptr<SeqRing<uint16_t>> got;
 
-// 文件
-std::ofstream out;
+// 一批数据报文对应的 ACK 先编码在这里，处理完整批后一起发出；flush 之前不能覆盖
+UdpBatchSender* acks = nullptr;
+std::vector<char> ackWire;
+size_t ackUsed = 0;
+
+// 文件：按偏移写入，乱序到达的报文段也直接落到它的位置
+OffsetFileSink out;
 } // namespace receiver
 
 // ---------- 工具 ----------
 inline void sendPkt(const RdtPacket& p) {
-    sendto(receiver::sock, reinterpret_cast<const char*>(&p), sizeof(p), 0,
+    char wire[RDT_MAX_PACKET];
+    int len = RdtProtocolHelper::encode(p, wire);
+    sendto(receiver::sock, wire, len, 0,
            reinterpret_cast<sockaddr*>(&receiver::peerAddr), receiver::addrLen);
 }
 
-inline RdtPacket makeAck(uint32_t ack, uint32_t win) {
+inline void flushAcks() {
+    receiver::acks->flush();
+    receiver::ackUsed = 0;
+}
+
+// ACK 都是 RDT_HEADER_LEN 字节，攒满一批再发；GSO 模式下整批等长，正好合成一个超大报文
+inline void queueAck(const RdtPacket& p) {
+    if (receiver::ackUsed + RDT_HEADER_LEN > receiver::ackWire.size()) flushAcks();
+    char* w = receiver::ackWire.data() + receiver::ackUsed;
+    receiver::ackUsed += RdtProtocolHelper::writeHeader(p, w);
+    receiver::acks->add(w, RDT_HEADER_LEN);
+}
+
+inline RdtPacket makeAck(uint32_t ack, uint32_t win, uint32_t sack = 0) {
     RdtPacket pkt{};
     pkt.type    = static_cast<uint8_t>(PacketType::ACK);
     pkt.ack_num = ack;
     pkt.win_size= win;
-    RdtProtocolHelper::setChecksum(pkt);
+    pkt.sack_mask = sack;
     return pkt;
 }
 
@@ -78,7 +115,6 @@ inline RdtPacket makeSetupAck(uint32_t ack, uint32_t win) {
     pkt.type    = static_cast<uint8_t>(PacketType::SETUP_ACK);
     pkt.ack_num = ack;
     pkt.win_size= win;
-    RdtProtocolHelper::setChecksum(pkt);
     return pkt;
 }
 
@@ -86,105 +122,223 @@ inline RdtPacket makeFinAck(uint32_t ack) {
     RdtPacket pkt{};
     pkt.type    = static_cast<uint8_t>(PacketType::FIN_ACK);
     pkt.ack_num = ack;
-    RdtProtocolHelper::setChecksum(pkt);
     return pkt;
 }
 
+// ---------- 流量控制 ----------
+// 当前要通告的窗口。空闲空间增加不到一个 MSS 时右沿不动，避免通告一串小窗口（糊涂窗口综合征）；
+// 右沿从不后退，已经允许发送的数据不会因为窗口缩小而被丢弃
+uint32_t advertise() {
+    uint32_t edge = receiver::baseSeq + (receiver::bufBytes - static_cast<uint32_t>(receiver::unread));
+    if (edge >= receiver::rightEdge + MSS) receiver::rightEdge = edge;
+    uint32_t win = receiver::rightEdge - receiver::baseSeq;
+    bool closed = win < MSS;
+    if (closed && !receiver::closed) ++receiver::zeroWindows;
+    receiver::closed = closed;
+    return win;
+}
+
+// ---------- SACK ----------
+// 第 i 位表示 baseSeq 之后第 i+1 个报文段（baseSeq + (i+1)*MSS）已在乱序缓存中
+uint32_t sackMask() {
+    uint32_t mask = 0;
+    uint32_t base = receiver::baseSeq;
+    receiver::got->for_each(base + MSS, base + 33 * MSS, [&mask, base](uint32_t seq, uint16_t&) {
+        mask |= 1u << ((seq - base) / MSS - 1);
+    });
+    return mask;
+}
+
+inline RdtPacket currentAck() {
+    return makeAck(receiver::baseSeq, advertise(), sackMask());
+}
+
+// ---------- 模拟慢速应用 ----------
+// 按设定速度读走缓冲区中的数据；窗口原先关着、现在能放下一个报文段时主动发一个窗口更新。
+// 更新丢了也不要紧，发送端的窗口探测会再问一次
+void appRead() {
+    clock_type::time_point now = clock_type::now();
+    double ms = std::chrono::duration<double, std::milli>(now - receiver::lastRead).count();
+    receiver::lastRead = now;
+    receiver::unread = std::max(0.0, receiver::unread - receiver::opt.appRate * 1000.0 * ms);  // MB/s = 1000 字节/ms
+    if (receiver::closed) {
+        RdtPacket ack = currentAck();
+        if (!receiver::closed) {
+            queueAck(ack);
+            ++receiver::windowUpdates;
+        }
+    }
+}
+
 // ---------- 模拟丢包 ----------
 bool shouldDrop() {
-    static std::mt19937 rng(static_cast<unsigned>(std::time(nullptr)));
+    static std::mt19937 rng(receiver::opt.seed ? receiver::opt.seed : static_cast<unsigned>(std::time(nullptr)));
     static std::uniform_real_distribution<double> dist(0.0, 1.0);
-    return dist(rng) < cfg::PACKET_LOSS_RATE;
+    return dist(rng) < receiver::opt.loss;
+}
+
+// ---------- 命令行 ----------
+bool parseArgs(int argc, char** argv, Options& o) {
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        bool hasVal = i + 1 < argc;
+        if (a == "--io" && hasVal) {
+            if (!parseIoMode(argv[++i], o.io)) return false;
+        } else if (a == "--loss" && hasVal) {
+            o.loss = std::atof(argv[++i]);
+        } else if (a == "--seed" && hasVal) {
+            o.seed = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (a == "--window" && hasVal) {
+            o.winPkts = static_cast<uint32_t>(std::atoi(argv[++i]));
+            if (o.winPkts == 0) return false;
+        } else if (a == "--app-rate" && hasVal) {
+            o.appRate = std::atof(argv[++i]);
+        } else if (a == "--port" && hasVal) {
+            o.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (a == "--out" && hasVal) {
+            o.file = argv[++i];
+        } else if (a == "--quiet") {
+            o.quiet = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+// ---------- 报文处理 ----------
+// 处理一个收到的报文（数据在 payload 处，不经过 pkt），收到 FIN 时返回 true
+bool handlePacket(const RdtPacket& pkt, const char* payload) {
+    if (pkt.type == static_cast<uint8_t>(PacketType::SETUP)) {
+        sendPkt(makeSetupAck(pkt.seq_num + 1, advertise()));
+        logInfo("SETUP received -> sent SETUP_ACK");
+    }
+    else if (pkt.type == static_cast<uint8_t>(PacketType::DATA)) {
+        uint32_t seq = pkt.seq_num;
+        uint32_t end = seq + pkt.data_len;
+
+        // 窗口外 → 直接重发当前 ACK
+        if (seq < receiver::baseSeq || end > receiver::rightEdge) {
+            queueAck(currentAck());
+            return false;
+        }
+
+        // 不论是否按序，都直接写到文件中的位置；重复到达的报文段覆盖同样的内容
+        if (seq == receiver::baseSeq || !receiver::got->contains(seq)) {
+            if (!receiver::out.write(seq, payload, pkt.data_len)) logInfo("Write failed at offset " + std::to_string(seq));
+        }
+        if (seq != receiver::baseSeq) {
+            receiver::got->insert(seq) = pkt.data_len;
+            if (!receiver::opt.quiet) logInfo("Stored out-of-order seq=" + std::to_string(seq));
+        } else {
+            // 顺序到达：越过之后已经写好的报文段，这些数据交给应用
+            uint32_t from = receiver::baseSeq;
+            receiver::baseSeq = end;
+            while (uint16_t* len = receiver::got->find(receiver::baseSeq)) {
+                receiver::got->erase(receiver::baseSeq);
+                receiver::baseSeq += *len;
+            }
+            if (receiver::opt.appRate > 0) receiver::unread += receiver::baseSeq - from;
+        }
+        queueAck(currentAck());
+    }
+    else if (pkt.type == static_cast<uint8_t>(PacketType::PROBE)) {
+        ++receiver::probes;
+        queueAck(currentAck());
+    }
+    else if (pkt.type == static_cast<uint8_t>(PacketType::FIN)) {
+        flushAcks();
+        sendPkt(makeFinAck(pkt.seq_num + 1));
+        return true;
+    }
+    return false;
 }
 
 // ---------- 主函数 ----------
-int main() {
+int main(int argc, char** argv) {
+#ifdef _WIN32
     // 设置控制台输出编码为 UTF-8
     SetConsoleOutputCP(CP_UTF8);
-    
-    WSADATA wsa;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa)) return 1;
-    InitializeCriticalSection(&receiver::csSR);
+#endif
+    if (!parseArgs(argc, argv, receiver::opt)) {
+        std::cerr << "usage: receiver [--io plain|mmsg|gso] [--loss P] [--seed N] [--window N] [--app-rate MBps] [--port N] [--out PATH] [--quiet]\n";
+        return 2;
+    }
+    if (!net_startup()) return 1;
+
+    receiver::bufBytes = receiver::opt.winPkts * MSS;
+    receiver::rightEdge = receiver::bufBytes;
+    receiver::got.reset(new SeqRing<uint16_t>(receiver::opt.winPkts, MSS));
 
     receiver::sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (receiver::sock == INVALID_SOCKET) return 1;
 
+    // 大窗口下一次可能涌来成百上千个报文，默认接收缓冲区容易溢出
+    int rcvBuf = 4 * 1024 * 1024;
+    setsockopt(receiver::sock, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<char*>(&rcvBuf), sizeof(rcvBuf));
+
     sockaddr_in local{};
     local.sin_family      = AF_INET;
-    local.sin_port        = htons(RDT_PORT);
+    local.sin_port        = htons(receiver::opt.port);
     local.sin_addr.s_addr = INADDR_ANY;
     if (bind(receiver::sock, reinterpret_cast<sockaddr*>(&local), sizeof(local)) == SOCKET_ERROR) {
-        closesocket(receiver::sock); WSACleanup(); return 1;
+        closesocket(receiver::sock); net_cleanup(); return 1;
     }
 
-    receiver::out.open(cfg::OUTPUT_FILE, std::ios::binary | std::ios::trunc);
-    if (!receiver::out) return 1;
+    if (!receiver::out.open(receiver::opt.file)) return 1;
 
-    logInfo("Receiver ready on port " + std::to_string(RDT_PORT));
+    logInfo("Receiver ready on port " + std::to_string(receiver::opt.port));
 
-    char buf[sizeof(RdtPacket)];
-    while (true) {
-        int n = recvfrom(receiver::sock, buf, sizeof(buf), 0,
-                         reinterpret_cast<sockaddr*>(&receiver::peerAddr), &receiver::addrLen);
-        if (n <= 0) continue;
+    UdpBatchReceiver rx(receiver::sock, receiver::opt.io, RDT_MAX_PACKET);
+    UdpBatchSender ackOut(receiver::sock, &receiver::peerAddr, receiver::opt.io);
+    receiver::acks = &ackOut;
+    receiver::ackWire.resize(static_cast<size_t>(BATCH_MAX) * GSO_MAX_SEGS * RDT_HEADER_LEN);
 
-        RdtPacket pkt;
-        memcpy(&pkt, buf, sizeof(pkt));
+    // 限速读取时不能一直阻塞在接收上，要定期读走数据、必要时发窗口更新
+    if (receiver::opt.appRate > 0) set_recv_timeout(receiver::sock, cfg::APP_TICK_MS);
+    receiver::lastRead = clock_type::now();
 
-        if (shouldDrop() && pkt.type == static_cast<uint8_t>(PacketType::DATA)) {
-            logInfo("Dropped DATA seq=" + std::to_string(pkt.seq_num));
-            continue;
-        }
+    RdtPacket pkt;
+    bool fin = false;
+    while (!fin) {
+        int n = rx.receive();
+        if (receiver::opt.appRate > 0) appRead();
 
-        if (!RdtProtocolHelper::isChecksumValid(pkt)) {
-            logInfo("Bad checksum, drop seq=" + std::to_string(pkt.seq_num));
-            continue;
-        }
-
-        Lock l(receiver::csSR);
-
-        if (pkt.type == static_cast<uint8_t>(PacketType::SETUP)) {
-            sendPkt(makeSetupAck(pkt.seq_num + 1, receiver::winSize));
-            logInfo("SETUP received -> sent SETUP_ACK");
-        }
-        else if (pkt.type == static_cast<uint8_t>(PacketType::DATA)) {
-            uint32_t seq = pkt.seq_num;
-            uint32_t end = seq + pkt.data_len;
-
-            // 窗口外 → 直接重发当前 ACK
-            if (seq < receiver::baseSeq || seq >= receiver::baseSeq + receiver::winSize) {
-                sendPkt(makeAck(receiver::baseSeq, receiver::winSize));
+        for (int i = 0; i < n && !fin; ++i) {
+            receiver::peerAddr = rx.from(i);
+            if (!RdtProtocolHelper::decodeHeader(rx.data(i), rx.len(i), pkt)) {
+                logInfo("Bad checksum or length, drop " + std::to_string(rx.len(i)) + " bytes");
                 continue;
             }
 
-            // 重复或乱序 → 缓存
-            if (seq != receiver::baseSeq) {
-                receiver::buf[seq] = pkt;
-                logInfo("Buffered out-of-order seq=" + std::to_string(seq));
-            } else {
-                // 顺序交付
-                receiver::out.write(pkt.payload, pkt.data_len);
-                receiver::baseSeq = end;
-                // 连续交付缓存
-                while (receiver::buf.count(receiver::baseSeq)) {
-                    RdtPacket& p = receiver::buf.at(receiver::baseSeq);
-                    receiver::out.write(p.payload, p.data_len);
-                    receiver::baseSeq += p.data_len;
-                    receiver::buf.erase(receiver::baseSeq - p.data_len);
-                }
+            if (pkt.type == static_cast<uint8_t>(PacketType::DATA) && shouldDrop()) {
+                if (!receiver::opt.quiet) logInfo("Dropped DATA seq=" + std::to_string(pkt.seq_num));
+                continue;
             }
-            sendPkt(makeAck(receiver::baseSeq, receiver::winSize));
+
+            fin = handlePacket(pkt, rx.data(i) + RDT_HEADER_LEN);
         }
-        else if (pkt.type == static_cast<uint8_t>(PacketType::FIN)) {
-            sendPkt(makeFinAck(pkt.seq_num + 1));
-            logInfo("FIN received -> sent FIN_ACK. Transfer complete.");
-            break;
+        flushAcks();
+    }
+    receiver::out.close();
+    logInfo("FIN received -> sent FIN_ACK. Transfer complete.");
+    logInfo("Flow control: window closed " + std::to_string(receiver::zeroWindows) + " times, probes " +
+            std::to_string(receiver::probes) + ", window updates " + std::to_string(receiver::windowUpdates));
+
+    // FIN_ACK 可能丢失，发送端会重发 FIN，在一小段时间内继续应答
+    set_recv_timeout(receiver::sock, cfg::LINGER_MS);
+    for (int n; (n = rx.receive()) > 0;) {
+        for (int i = 0; i < n; ++i) {
+            if (RdtProtocolHelper::decodeHeader(rx.data(i), rx.len(i), pkt) &&
+                pkt.type == static_cast<uint8_t>(PacketType::FIN)) {
+                receiver::peerAddr = rx.from(i);
+                sendPkt(makeFinAck(pkt.seq_num + 1));
+            }
         }
     }
 
-    receiver::out.close();
-    DeleteCriticalSection(&receiver::csSR);
+    logInfo("Syscalls: recv " + std::to_string(rx.syscalls()) + ", send " + std::to_string(ackOut.syscalls()));
     closesocket(receiver::sock);
-    WSACleanup();
+    net_cleanup();
     return 0;
-}
\ No newline at end of file
+}
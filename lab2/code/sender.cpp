@@ -1,27 +1,26 @@
-// sender.cpp -- RDT Sender (UDP + TCP-Reno + SR + SACK)
-// g++ -std=c++17 -O2 -Wall -Wextra -o sender.exe sender.cpp -lws2_32
-#define WIN32_LEAN_AND_MEAN
-#define NOMINMAX
-#define _WIN32_WINNT 0x0600  // 为了使用 inet_pton
-#include <windows.h>
-#include <winsock2.h>
-#include <ws2tcpip.h>
-#pragma comment(lib, "ws2_32.lib")
+// sender.cpp -- RDT Sender (UDP + SR + SACK + 可选拥塞控制 Reno/CUBIC/BBR)
+// Windows: g++ -std=c++17 -O2 -Wall -Wextra -o sender.exe sender.cpp -lws2_32
+// Linux  : g++ -std=c++17 -O2 -Wall -Wextra -o sender sender.cpp -pthread
+// 用法: sender [--cc reno|cubic|bbr] [--io plain|mmsg|gso] [--pacing] [--host IP] [--port N] [--file PATH] [--trace PATH] [--quiet]
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <cstdint>
-#include <iostream>
+#include <cstdlib>
 #include <fstream>
-#include <map>
+#include <iostream>
 #include <chrono>
+#include <condition_variable>
 #include <iomanip>
+#include <mutex>
 #include <thread>
+#include <vector>
 #include "rdt.hpp"
-
-// 定义Reno状态枚举
-enum RenoState { 
-    RENO_SLOW_START,
-    RENO_CA,
-    RENO_FAST_RECOVERY
-};
+#include "batch_io.hpp"
+#include "congestion.hpp"
+#include "file_map.hpp"
+#include "seq_ring.hpp"
+#include "timer_wheel.hpp"
 
 using std::cout;
 using std::endl;
@@ -37,64 +36,149 @@ namespace cfg {
     constexpr const char* INPUT_FILE = "test.jpg";
     constexpr uint32_t SND_BUF_SZ = 4 * 1024 * 1024;
     constexpr uint32_t RCV_BUF_SZ = 4 * 1024 * 1024;
+    constexpr uint32_t WINDOW_SLOTS = 65536; // 发送窗口最多容纳的报文段数（64 MB）
+    constexpr unsigned RECV_POLL_MS = 100;   // 接收线程检查退出标志的间隔
+    constexpr unsigned SETUP_WAIT_MS = 5000; // 等待 SETUP_ACK 的总时长
+    constexpr unsigned SETUP_RETRY_MS = 200; // SETUP 的重发间隔
+    constexpr unsigned FIN_WAIT_MS = 2000;   // 等待 FIN_ACK 的总时长
+    constexpr unsigned FIN_RETRY_MS = 200;   // FIN 的重发间隔
+    constexpr double PACE_GAIN_SS = 2.0;     // 慢启动时按 2 倍 cwnd/SRTT 发送，否则窗口来不及增长
+    constexpr double PACE_GAIN_CA = 1.2;     // 拥塞避免时略高于 cwnd/SRTT，补偿唤醒误差
+    constexpr int PACE_BURST = 4;            // 空闲后最多攒下的发送额度（报文段数）
 }
 
+// 命令行参数，默认值见 cfg
+struct Options {
+    string host = cfg::SERVER_IP;
+    uint16_t port = cfg::SERVER_PORT;
+    string file = cfg::INPUT_FILE;
+    string cc = "reno";
+    string trace;        // 拥塞窗口轨迹输出文件（CSV），为空时不记录
+    IoMode io = IoMode::Plain;
+    bool quiet = false;  // 不打印逐个 ACK 的日志
+    bool pacing = false; // 按 cwnd/SRTT 均匀发送，而不是窗口一打开就整窗突发
+};
+
 // ---------- 日志 ----------
 inline void logInfo(const string& s) { cout << "[SENDER] " << s << endl; }
 
 // ---------- RAII 锁 ----------
-struct Lock {
-    CRITICAL_SECTION& cs_;
-    explicit Lock(CRITICAL_SECTION& cs) : cs_(cs) { EnterCriticalSection(&cs_); }
-    ~Lock() { LeaveCriticalSection(&cs_); }
-};
+// 同一线程会在已持有锁时再次进入（如 onDupAck 在接收线程加锁后调用），所以用递归锁
+using Lock = std::lock_guard<std::recursive_mutex>;
 
 // ---------- 全局状态 ----------
 namespace sender {
     SOCKET sock;
     sockaddr_in srvAddr{};
-    int addrLen = sizeof(sockaddr_in);
-    CRITICAL_SECTION csReno;
-    CRITICAL_SECTION csSR;
+    socklen_t addrLen = sizeof(sockaddr_in);
+    std::recursive_mutex csCC;
+    std::recursive_mutex csSR;
+    Options opt;
+    std::atomic<bool> finAcked{ false };
+    std::atomic<bool> stop{ false };
+    
+    // 当前线程的批量发送器：transmit 把报文段交给它，持锁的一段处理结束时统一 flush
+    thread_local UdpBatchSender* batch = nullptr;
+    uint64_t sendCalls = 0;
+    uint64_t recvCalls = 0;
     
     // 文件
     uint32_t fileSize = 0;
-    std::ifstream file;
+    MappedFile src;           // 只读映射，报文段的数据直接指向这里
     
-    // RENO
-    double cwnd = 1.0;
-    double ssthresh = 64.0;
-    RenoState renoState = RENO_SLOW_START;
+    // 拥塞控制：窗口和速率由控制器决定，丢包检测和快速恢复的进出在这里
+    std::unique_ptr<CongestionControl> cc;
+    bool inRecovery = false;
     int dupAck = 0;
     
     // SR
     uint32_t baseSeq = 0;
     uint32_t nextSeq = 0;
-    uint32_t peerWin = 0;
+    uint32_t peerWin = 0;     // 对方通告的窗口，从 baseSeq 算起
     
     struct Unacked {
-        RdtPacket pkt;
-        clock_type::time_point ts;
+        char hdr[RDT_HEADER_LEN];   // 编码好的头部，重传时原样发送，不再重新计算校验和
+        const char* payload = nullptr;  // 指向映射的文件，不另存数据
+        uint16_t dataLen = 0;
+        clock_type::time_point ts;  // 最近一次发送的时间
+        int txCount = 0;      // 发送次数，重传过的不用来估计 RTT
+        bool sacked = false;  // 接收方已缓存，不必重传
+        bool retx = false;    // 本轮恢复中已重传过
+        TimerNode timer;      // 该报文段的重传定时器，key 为序号
+        // 发送时的交付进度，被确认时据此计算交付速率
+        uint64_t priorDelivered = 0;
+        clock_type::time_point priorDeliveredTs;
+        clock_type::time_point priorFirstSent;
+    };
+    SeqRing<Unacked> winRing(cfg::WINDOW_SLOTS, MSS);  // 在途报文段，按序号索引
+    uint32_t highSack = 0;    // 已被 SACK 的最高报文段的末尾，其下未被 SACK 的都是空洞
+    
+    // RTO（RFC 6298），单位毫秒
+    double srtt = 0;          // 0 表示还没有样本
+    double rttvar = 0;
+    uint32_t rtoMs = TIMEOUT_MS;
+    uint32_t recover = 0;     // 上次超时时的 nextSeq，在此之前只发过一次的报文段再超时算同一次
+    TimerWheel wheel;         // 1 tick = 1 ms，从 t0 开始计
+    uint64_t retransmits = 0;
+    
+    // 零窗口探测：对方窗口关闭且没有在途数据时，不会再有 ACK 带来窗口更新，靠定时探测
+    TimerNode persist;        // 挂在同一个时间轮上，key 为 PERSIST_KEY
+    uint32_t persistMs = 0;   // 当前探测间隔，每次探测后加倍
+    uint64_t probes = 0;
+    
+    // 交付速率采样
+    uint64_t delivered = 0;              // 已被确认（累计或 SACK）的字节数
+    clock_type::time_point deliveredTs;  // 最近一次交付的时间
+    clock_type::time_point firstSentTs;  // 最近交付的报文段的发送时间
+    
+    // 拥塞窗口轨迹，每毫秒最多一个点，结束后写到 opt.trace
+    struct TraceSample {
+        uint64_t tick;
+        double cwnd;
+        double ssthresh;
+        uint32_t inFlight;    // 字节
     };
-    std::map<uint32_t, Unacked> winMap;
+    std::vector<TraceSample> trace;
     
     // 计时
     clock_type::time_point t0;
+    
+    // 节奏：下一个新报文段最早的发送时间
+    clock_type::time_point paceNext;
+    
+    // 主线程的唤醒事件（自动复位）：有 ACK 到达或 FIN_ACK 时由接收线程置位
+    std::mutex evMutex;
+    std::condition_variable evCond;
+    bool evSet = false;
 }
 
+// 报文段序号都是 MSS 的整数倍，不会与它冲突
+#define PERSIST_KEY 0xFFFFFFFFu
+
 // ---------- 工具 ----------
-inline void sendPkt(const RdtPacket& p) {
-    sendto(sender::sock, reinterpret_cast<const char*>(&p), sizeof(p), 0, 
+inline void sendWire(const char* wire, int len) {
+    sendto(sender::sock, wire, len, 0,
            reinterpret_cast<sockaddr*>(&sender::srvAddr), sender::addrLen);
 }
 
+inline void sendPkt(const RdtPacket& p) {
+    char wire[RDT_MAX_PACKET];
+    sendWire(wire, RdtProtocolHelper::encode(p, wire));
+}
+
 inline RdtPacket makeDataPkt(uint32_t seq, uint16_t len) {
     RdtPacket p{};
     p.type = static_cast<uint8_t>(PacketType::DATA);
     p.seq_num = seq;
     p.data_len = len;
     p.win_size = cfg::RCV_BUF_SZ;
-    RdtProtocolHelper::setChecksum(p);
+    return p;
+}
+
+inline RdtPacket makeProbePkt() {
+    RdtPacket p{};
+    p.type = static_cast<uint8_t>(PacketType::PROBE);
+    p.win_size = cfg::RCV_BUF_SZ;
     return p;
 }
 
@@ -102,115 +186,343 @@ inline RdtPacket makeFinPkt(uint32_t seq) {
     RdtPacket p{};
     p.type = static_cast<uint8_t>(PacketType::FIN);
     p.seq_num = seq;
-    RdtProtocolHelper::setChecksum(p);
     return p;
 }
 
-// ---------- RENO ----------
-void renoTimeout() {
-    Lock l(sender::csReno);
-    sender::ssthresh = std::max(sender::cwnd / 2.0, 2.0);
-    sender::cwnd = 1.0;
-    sender::renoState = RENO_SLOW_START;
+// ---------- 唤醒 ----------
+void wakeSender() {
+    {
+        std::lock_guard<std::mutex> l(sender::evMutex);
+        sender::evSet = true;
+    }
+    sender::evCond.notify_one();
+}
+
+// 等到事件被置位或到达 deadline，两者先到者为准
+void waitSender(clock_type::time_point deadline) {
+    std::unique_lock<std::mutex> l(sender::evMutex);
+    sender::evCond.wait_until(l, deadline, [] { return sender::evSet; });
+    sender::evSet = false;
+}
+
+// ---------- RTO ----------
+inline uint64_t nowTick() {
+    return std::chrono::duration_cast<ms>(clock_type::now() - sender::t0).count();
+}
+
+// 发送（或重发）一个报文段，并按当前 RTO 重新启动它的定时器
+void transmit(sender::Unacked& u) {
+    if (sender::batch) {
+        sender::batch->add(u.hdr, RDT_HEADER_LEN, u.payload, u.dataLen);
+    } else {
+        UdpBatchSender one(sender::sock, &sender::srvAddr, IoMode::Plain);
+        one.add(u.hdr, RDT_HEADER_LEN, u.payload, u.dataLen);
+        one.flush();
+    }
+    u.ts = clock_type::now();
+    // 没有在途数据时从现在开始计交付区间，避免把空闲时间算进去
+    if (sender::nextSeq == sender::baseSeq) sender::deliveredTs = sender::firstSentTs = u.ts;
+    u.priorDelivered = sender::delivered;
+    u.priorDeliveredTs = sender::deliveredTs;
+    u.priorFirstSent = sender::firstSentTs;
+    if (++u.txCount > 1) ++sender::retransmits;
+    sender::wheel.arm(u.timer, nowTick() + sender::rtoMs);
+}
+
+// 报文段刚被确认时取一个 RTT 样本；按 Karn 算法，重传过的报文段不取样。
+// 新样本同时清除超时造成的指数退避
+void sampleRtt(const sender::Unacked& u) {
+    if (u.txCount != 1) return;
+    double r = std::chrono::duration<double, std::milli>(clock_type::now() - u.ts).count();
+    if (sender::srtt == 0) {
+        sender::srtt = r;
+        sender::rttvar = r / 2;
+    } else {
+        sender::rttvar = 0.75 * sender::rttvar + 0.25 * std::fabs(sender::srtt - r);
+        sender::srtt = 0.875 * sender::srtt + 0.125 * r;
+    }
+    double rto = std::ceil(sender::srtt + std::max(1.0, 4 * sender::rttvar));  // 1 ms 为时钟粒度
+    sender::rtoMs = static_cast<uint32_t>(std::clamp(rto, double(RTO_MIN_MS), double(RTO_MAX_MS)));
+    sender::cc->onRttSample(r);
+}
+
+// 报文段第一次被确认（累计或 SACK）时交给控制器一个交付速率样本。
+// 区间取发送区间和确认区间中较长的，避免 ACK 压缩时高估带宽
+void deliver(const sender::Unacked& u) {
+    clock_type::time_point now = clock_type::now();
+    sender::delivered += u.dataLen;
+    sender::deliveredTs = now;
+    sender::firstSentTs = u.ts;
+    
+    RateSample rs;
+    rs.delivered = sender::delivered;
+    rs.priorDelivered = u.priorDelivered;
+    rs.intervalMs = std::chrono::duration<double, std::milli>(
+        std::max(u.ts - u.priorFirstSent, now - u.priorDeliveredTs)).count();
+    if (u.txCount == 1) rs.rttMs = std::chrono::duration<double, std::milli>(now - u.ts).count();
+    rs.inFlight = sender::nextSeq - sender::baseSeq;
+    sender::cc->onRateSample(rs);
+}
+
+// ---------- 节奏 ----------
+// 控制器给出速率（BBR）时按它发送，不受 --pacing 影响；
+// 否则开启 --pacing 后新报文段之间间隔 SRTT / (gain * cwnd)，还没有 RTT 样本时不限速
+bool paceEnabled() {
+    return sender::cc->pacingRate() > 0 || (sender::opt.pacing && sender::srtt > 0);
+}
+
+clock_type::duration paceGap() {
+    double rate = sender::cc->pacingRate();  // 字节/毫秒
+    if (rate <= 0) {
+        double gain = sender::cc->slowStart() ? cfg::PACE_GAIN_SS : cfg::PACE_GAIN_CA;
+        rate = gain * sender::cc->cwnd() * MSS / sender::srtt;
+    }
+    std::chrono::duration<double, std::milli> gap(MSS / rate);
+    return std::chrono::duration_cast<clock_type::duration>(gap);
+}
+
+// 现在能否发出一个新报文段，能发时记下下一个的发送时间
+bool paceAllow(clock_type::time_point now) {
+    if (!paceEnabled()) return true;
+    if (now < sender::paceNext) return false;
+    clock_type::duration gap = paceGap();
+    // 空闲了一段时间后不补发积累的额度，最多允许 PACE_BURST 个报文段连发
+    sender::paceNext = std::max(sender::paceNext, now - cfg::PACE_BURST * gap) + gap;
+    return true;
+}
+
+// ---------- SACK ----------
+// 按 ACK 中的位图标记接收方已缓存的报文段（第 i 位对应 ack + (i+1)*MSS）
+void applySack(uint32_t ack, uint32_t mask) {
+    for (uint32_t i = 0; mask; ++i, mask >>= 1) {
+        if (!(mask & 1)) continue;
+        uint32_t seq = ack + (i + 1) * MSS;
+        sender::Unacked* u = sender::winRing.find(seq);
+        if (!u || u->sacked) continue;
+        sampleRtt(*u);
+        deliver(*u);
+        sender::wheel.cancel(u->timer);
+        u->sacked = true;
+        sender::highSack = std::max(sender::highSack, seq + u->dataLen);
+    }
+}
+
+// 一轮内重传所有空洞：baseSeq 以及 highSack 以下未被 SACK 的报文段，本轮已重传过的跳过
+void retransmitHoles() {
+    int n = 0;
+    uint32_t end = std::max(sender::highSack, sender::baseSeq + 1);
+    sender::winRing.for_each(sender::baseSeq, end, [&n](uint32_t, sender::Unacked& u) {
+        if (u.sacked || u.retx) return;
+        transmit(u);
+        u.retx = true;
+        ++n;
+    });
+    if (n > 1) logInfo("SACK retransmit " + std::to_string(n) + " holes");
+}
+
+// 开始新一轮恢复：之前重传过的空洞可能再次丢失，允许重新发送
+void resetRetx() {
+    sender::winRing.for_each(sender::baseSeq, sender::nextSeq, [](uint32_t, sender::Unacked& u) {
+        u.retx = false;
+    });
+}
+
+// ---------- 丢包检测与恢复 ----------
+inline string ccState() {
+    return "cwnd=" + std::to_string(sender::cc->cwnd()) + " ssthresh=" + std::to_string(sender::cc->ssthresh());
+}
+
+// 一次超时事件：降窗并把 RTO 加倍，重传由到期的定时器各自完成
+void lossTimeout() {
+    Lock l(sender::csCC);
+    sender::cc->onTimeout();
+    sender::inRecovery = false;
     sender::dupAck = 0;
-    logInfo("Timeout -> cwnd=" + std::to_string(sender::cwnd) + " ssthresh=" + std::to_string(sender::ssthresh));
+    sender::rtoMs = std::min(sender::rtoMs * 2, static_cast<uint32_t>(RTO_MAX_MS));
+    sender::recover = sender::nextSeq;
+    logInfo("Timeout -> " + ccState() + " rto=" + std::to_string(sender::rtoMs));
     
-    auto it = sender::winMap.find(sender::baseSeq);
-    if (it != sender::winMap.end()) {
-        sendPkt(it->second.pkt);
-        it->second.ts = clock_type::now();
+    resetRetx();
+}
+
+// 某个报文段的定时器到期：新的丢失（不是同一次超时里其他在途报文段跟着到期）才按超时处理，然后重传它
+void onSegmentTimeout(uint32_t seq) {
+    sender::Unacked* u = sender::winRing.find(seq);
+    if (!u || u->sacked) return;
+    if (seq >= sender::recover || u->txCount > 1) lossTimeout();
+    transmit(*u);
+    u->retx = true;
+}
+
+// 探测定时器到期：发一个探测报文，间隔指数退避，直到窗口重新打开
+void onPersistTimeout() {
+    sendPkt(makeProbePkt());
+    ++sender::probes;
+    sender::persistMs = std::min(sender::persistMs * 2, static_cast<uint32_t>(RTO_MAX_MS));
+    sender::wheel.arm(sender::persist, nowTick() + sender::persistMs);
+}
+
+void onTimer(uint32_t key) {
+    if (key == PERSIST_KEY) onPersistTimeout();
+    else onSegmentTimeout(key);
+}
+
+// 窗口关闭（放不下一个报文段）且没有在途数据时启动探测，否则停止
+void updatePersist() {
+    bool closed = sender::nextSeq < sender::fileSize && sender::winRing.empty() && sender::peerWin < MSS;
+    if (!closed) {
+        sender::wheel.cancel(sender::persist);
+    } else if (!sender::persist.armed()) {
+        if (!sender::opt.quiet) logInfo("Zero window, probing");
+        sender::persistMs = sender::rtoMs;
+        sender::wheel.arm(sender::persist, nowTick() + sender::persistMs);
     }
 }
 
-void renoNewAck(uint32_t newBase) {
-    Lock l(sender::csReno);
+void onNewAck(uint32_t newBase) {
+    Lock l(sender::csCC);
     uint32_t acked = newBase - sender::baseSeq;
     int segs = static_cast<int>(acked / MSS);
     
-    for (uint32_t s = sender::baseSeq; s < newBase; s += MSS) {
-        sender::winMap.erase(s);
-    }
+    // 刚好止于 newBase 的报文段没有被 SACK 过，说明这个 ACK 就是它触发的
+    sender::Unacked* last = sender::winRing.find((newBase - 1) / MSS * MSS);
+    if (last && !last->sacked) sampleRtt(*last);
+    sender::winRing.for_each(sender::baseSeq, newBase, [](uint32_t seq, sender::Unacked& u) {
+        if (!u.sacked) deliver(u);
+        sender::wheel.cancel(u.timer);
+        sender::winRing.erase(seq);
+    });
     
     sender::baseSeq = newBase;
+    // 部分确认后仍有已知空洞时立即补发，不等下一轮重复 ACK 或超时
+    if (sender::highSack > newBase) retransmitHoles();
+    else sender::highSack = newBase;
     
-    switch (sender::renoState) {
-        case RENO_SLOW_START:
-            sender::cwnd += segs;
-            if (sender::cwnd >= sender::ssthresh) {
-                sender::renoState = RENO_CA;
-            }
-            break;
-        case RENO_CA:
-            sender::cwnd += static_cast<double>(segs) / sender::cwnd;
-            break;
-        case RENO_FAST_RECOVERY:
-            sender::cwnd = sender::ssthresh;
-            sender::renoState = RENO_CA;
-            break;
+    // 任何新 ACK 都结束快速恢复，窗口收缩到门限，这个 ACK 本身不再增窗
+    if (sender::inRecovery) {
+        sender::inRecovery = false;
+        sender::cc->onRecoveryExit();
+    } else {
+        sender::cc->onAck(segs);
     }
     
     sender::dupAck = 0;
-    logInfo("NewACK -> cwnd=" + std::to_string(sender::cwnd) + " base=" + std::to_string(sender::baseSeq));
+    if (!sender::opt.quiet) logInfo("NewACK -> cwnd=" + std::to_string(sender::cc->cwnd()) + " base=" + std::to_string(sender::baseSeq));
 }
 
-void renoDupAck() {
-    Lock l(sender::csReno);
+void onDupAck() {
+    Lock l(sender::csCC);
     ++sender::dupAck;
     
-    if (sender::renoState == RENO_SLOW_START || sender::renoState == RENO_CA) {
+    if (!sender::inRecovery) {
         if (sender::dupAck == 3) {
-            sender::ssthresh = std::max(sender::cwnd / 2.0, 2.0);
-            sender::cwnd = sender::ssthresh + 3;
-            sender::renoState = RENO_FAST_RECOVERY;
-            logInfo("FastRetransmit -> cwnd=" + std::to_string(sender::cwnd));
+            sender::cc->onLoss();
+            sender::inRecovery = true;
+            logInfo("FastRetransmit -> " + ccState());
             
-            auto it = sender::winMap.find(sender::baseSeq);
-            if (it != sender::winMap.end()) {
-                sendPkt(it->second.pkt);
-                it->second.ts = clock_type::now();
-            }
+            resetRetx();
+            retransmitHoles();
         }
-    } else if (sender::renoState == RENO_FAST_RECOVERY) {
-        sender::cwnd += 1.0;
+    } else {
+        sender::cc->onRecoveryDupAck();
+        // 新的 SACK 信息可能揭示新的空洞
+        retransmitHoles();
     }
 }
 
 // ---------- 接收线程 ----------
-DWORD WINAPI recvThread(LPVOID) {
-    char buf[sizeof(RdtPacket)];
-    while (true) {
-        int n = recvfrom(sender::sock, buf, sizeof(buf), 0, nullptr, nullptr);
+// 一次取出所有已到达的 ACK 逐个处理，其间触发的重传攒在本线程的批里，处理完一起发出
+void recvThread() {
+    UdpBatchReceiver rx(sender::sock, sender::opt.io, RDT_MAX_PACKET);
+    UdpBatchSender out(sender::sock, &sender::srvAddr, sender::opt.io);
+    sender::batch = &out;
+    RdtPacket pkt;
+    while (!sender::stop) {
+        int n = rx.receive();
         if (n <= 0) continue;
         
-        RdtPacket pkt;
-        memcpy(&pkt, buf, sizeof(pkt));
-        
-        if (!RdtProtocolHelper::isChecksumValid(pkt)) continue;
-        
-        if (pkt.type == static_cast<uint8_t>(PacketType::ACK)) {
-            Lock lr(sender::csReno), ls(sender::csSR);
-            sender::peerWin = pkt.win_size;
+        Lock lr(sender::csCC), ls(sender::csSR);
+        for (int i = 0; i < n; ++i) {
+            if (!RdtProtocolHelper::decode(rx.data(i), rx.len(i), pkt)) continue;
             
-            if (pkt.ack_num > sender::baseSeq) {
-                renoNewAck(pkt.ack_num);
-            } else if (pkt.ack_num == sender::baseSeq && sender::nextSeq > sender::baseSeq) {
-                renoDupAck();
+            if (pkt.type == static_cast<uint8_t>(PacketType::ACK)) {
+                // 乱序到达的旧 ACK 带的是过时的窗口
+                if (pkt.ack_num < sender::baseSeq) continue;
+                sender::peerWin = pkt.win_size;
+                applySack(pkt.ack_num, pkt.sack_mask);
+                
+                if (pkt.ack_num > sender::baseSeq) {
+                    onNewAck(pkt.ack_num);
+                } else if (pkt.ack_num == sender::baseSeq && sender::nextSeq > sender::baseSeq) {
+                    onDupAck();
+                }
+            } else if (pkt.type == static_cast<uint8_t>(PacketType::FIN_ACK)) {
+                logInfo("Received FIN_ACK");
+                sender::finAcked = true;
+                sender::stop = true;
             }
-        } else if (pkt.type == static_cast<uint8_t>(PacketType::FIN_ACK)) {
-            logInfo("Received FIN_ACK");
-            break;
         }
+        out.flush();
+        wakeSender();
     }
-    return 0;
+    sender::batch = nullptr;
+    sender::sendCalls += out.syscalls();
+    sender::recvCalls += rx.syscalls();
+}
+
+// ---------- 轨迹 ----------
+void traceCwnd() {
+    if (sender::opt.trace.empty()) return;
+    uint64_t tick = nowTick();
+    if (!sender::trace.empty() && sender::trace.back().tick == tick) return;
+    sender::trace.push_back({ tick, sender::cc->cwnd(), sender::cc->ssthresh(), sender::nextSeq - sender::baseSeq });
+}
+
+bool writeTrace(const string& path) {
+    std::ofstream f(path);
+    if (!f) return false;
+    f << "ms,cwnd,ssthresh,inflight\n";
+    for (const sender::TraceSample& t : sender::trace) {
+        f << t.tick << ',' << t.cwnd << ',' << t.ssthresh << ',' << t.inFlight << '\n';
+    }
+    return static_cast<bool>(f);
+}
+
+// ---------- 命令行 ----------
+bool parseArgs(int argc, char** argv, Options& o) {
+    for (int i = 1; i < argc; ++i) {
+        string a = argv[i];
+        bool hasVal = i + 1 < argc;
+        if (a == "--io" && hasVal) {
+            if (!parseIoMode(argv[++i], o.io)) return false;
+        } else if (a == "--host" && hasVal) {
+            o.host = argv[++i];
+        } else if (a == "--port" && hasVal) {
+            o.port = static_cast<uint16_t>(std::atoi(argv[++i]));
+        } else if (a == "--file" && hasVal) {
+            o.file = argv[++i];
+        } else if (a == "--cc" && hasVal) {
+            o.cc = argv[++i];
+        } else if (a == "--trace" && hasVal) {
+            o.trace = argv[++i];
+        } else if (a == "--pacing") {
+            o.pacing = true;
+        } else if (a == "--quiet") {
+            o.quiet = true;
+        } else {
+            return false;
+        }
+    }
+    return true;
 }
 
 // ---------- 主函数 ----------
-int main() {
-    WSADATA wsa;
-    if (WSAStartup(MAKEWORD(2, 2), &wsa)) return 1;
-    
-    InitializeCriticalSection(&sender::csReno);
-    InitializeCriticalSection(&sender::csSR);
+int main(int argc, char** argv) {
+    if (!parseArgs(argc, argv, sender::opt) || !(sender::cc = makeCongestionControl(sender::opt.cc))) {
+        cerr << "usage: sender [--cc reno|cubic|bbr] [--io plain|mmsg|gso] [--pacing] [--host IP] [--port N] [--file PATH] [--trace PATH] [--quiet]\n";
+        return 2;
+    }
+    if (!net_startup()) return 1;
     
     sender::sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
     if (sender::sock == INVALID_SOCKET) return 1;
@@ -221,25 +533,40 @@ int main() {
     setsockopt(sender::sock, SOL_SOCKET, SO_RCVBUF, reinterpret_cast<char*>(&opt), sizeof(opt));
     
     sender::srvAddr.sin_family = AF_INET;
-    sender::srvAddr.sin_port = htons(cfg::SERVER_PORT);
+    sender::srvAddr.sin_port = htons(sender::opt.port);
     
     // 修复1: 使用正确的 inet_pton 函数（小写）
-    if (inet_pton(AF_INET, cfg::SERVER_IP, &sender::srvAddr.sin_addr) != 1) {
+    if (inet_pton(AF_INET, sender::opt.host.c_str(), &sender::srvAddr.sin_addr) != 1) {
         cerr << "Failed to convert IP address" << endl;
         return 1;
     }
     
-    // handshake
+    // handshake：SETUP 或 SETUP_ACK 丢失时定期重发，最多等 SETUP_WAIT_MS
     RdtPacket setup{};
     setup.type = static_cast<uint8_t>(PacketType::SETUP);
     setup.win_size = cfg::RCV_BUF_SZ;
-    RdtProtocolHelper::setChecksum(setup);
-    sendPkt(setup);
     
     RdtPacket setupAck{};
-    if (recvfrom(sender::sock, reinterpret_cast<char*>(&setupAck), sizeof(setupAck), 0, 
-                reinterpret_cast<sockaddr*>(&sender::srvAddr), &sender::addrLen) <= 0 ||
-        setupAck.type != static_cast<uint8_t>(PacketType::SETUP_ACK)) {
+    char wire[RDT_MAX_PACKET];
+    bool connected = false;
+    set_recv_timeout(sender::sock, cfg::SETUP_RETRY_MS);
+    clock_type::time_point setupDeadline = clock_type::now() + ms(cfg::SETUP_WAIT_MS);
+    while (!connected && clock_type::now() < setupDeadline) {
+        sendPkt(setup);
+        clock_type::time_point until = clock_type::now() + ms(cfg::SETUP_RETRY_MS);
+        // 超时或收到无关报文时继续等，直到本轮重发间隔用完
+        while (!connected && clock_type::now() < until) {
+            sockaddr_in from{};
+            socklen_t fromLen = sizeof(from);
+            int n = recvfrom(sender::sock, wire, sizeof(wire), 0, reinterpret_cast<sockaddr*>(&from), &fromLen);
+            if (n > 0 && RdtProtocolHelper::decode(wire, n, setupAck) &&
+                setupAck.type == static_cast<uint8_t>(PacketType::SETUP_ACK)) {
+                sender::srvAddr = from;
+                connected = true;
+            }
+        }
+    }
+    if (!connected) {
         cerr << "Handshake failed\n";
         return 1;
     }
@@ -247,71 +574,105 @@ int main() {
     sender::peerWin = setupAck.win_size;
     logInfo("Handshake done, peerWin=" + std::to_string(sender::peerWin));
     
-    // read file
-    sender::file.open(cfg::INPUT_FILE, std::ios::binary | std::ios::ate);
-    if (!sender::file) return 1;
-    sender::fileSize = static_cast<uint32_t>(sender::file.tellg());
-    sender::file.seekg(0);
+    // map file：序号是 32 位字节偏移，文件不能超过 4 GB
+    if (!sender::src.open(sender::opt.file) || sender::src.size() > UINT32_MAX) {
+        cerr << "Cannot map " << sender::opt.file << "\n";
+        return 1;
+    }
+    sender::fileSize = static_cast<uint32_t>(sender::src.size());
     
-    // start recv thread
+    // start recv thread：接收超时让它能定期检查退出标志
+    set_recv_timeout(sender::sock, cfg::RECV_POLL_MS);
     sender::t0 = clock_type::now();
-    HANDLE hRecv = CreateThread(nullptr, 0, recvThread, nullptr, 0, nullptr);
+    sender::persist.key = PERSIST_KEY;
+    std::thread recv(recvThread);
+    
+    // 主线程的发送批：一轮里到期重传和新报文段一起发出
+    UdpBatchSender out(sender::sock, &sender::srvAddr, sender::opt.io);
+    sender::batch = &out;
     
-    // main send loop
-    while (sender::baseSeq < sender::fileSize || !sender::winMap.empty()) {
-        // timeout check
+    // main send loop：没有事可做时睡到下一个 ACK、定时器到期或节奏允许发送，不轮询
+    while (sender::baseSeq < sender::fileSize || !sender::winRing.empty()) {
+        clock_type::time_point wakeAt;
         {
-            Lock l(sender::csSR);
-            auto it = sender::winMap.find(sender::baseSeq);
-            if (it != sender::winMap.end() && 
-                std::chrono::duration_cast<ms>(clock_type::now() - it->second.ts).count() > TIMEOUT_MS) {
-                renoTimeout();
-            }
-        }
-        
-        // send window
-        uint32_t cwndBytes = static_cast<uint32_t>(sender::cwnd * MSS);
-        uint32_t winBytes = std::min(cwndBytes, sender::peerWin);
-        uint32_t inFlight = sender::nextSeq - sender::baseSeq;
-        uint32_t canSend = (winBytes > inFlight) ? winBytes - inFlight : 0;
-        
-        while (canSend >= MSS && sender::nextSeq < sender::fileSize) {
-            RdtPacket pkt = makeDataPkt(sender::nextSeq, MSS);
-            sender::file.read(pkt.payload, MSS);
-            pkt.data_len = static_cast<uint16_t>(sender::file.gcount());
-            RdtProtocolHelper::setChecksum(pkt);
+            Lock lr(sender::csCC), ls(sender::csSR);
+            // timeout check：推进时间轮，到期的报文段各自重传
+            sender::wheel.advance(nowTick(), onTimer);
+            clock_type::time_point now = clock_type::now();
             
-            {
-                Lock l(sender::csSR);
-                sender::winMap[sender::nextSeq] = {pkt, clock_type::now()};
-                sendPkt(pkt);
+            // send window
+            uint32_t cwndBytes = static_cast<uint32_t>(sender::cc->cwnd() * MSS);
+            uint32_t winBytes = std::min({ cwndBytes, sender::peerWin,
+                                           static_cast<uint32_t>(sender::winRing.capacity() * MSS) });
+            uint32_t inFlight = sender::nextSeq - sender::baseSeq;
+            uint32_t canSend = (winBytes > inFlight) ? winBytes - inFlight : 0;
+            
+            bool paced = false;  // 窗口还有空间，但被节奏挡住了
+            while (canSend >= MSS && sender::nextSeq < sender::fileSize) {
+                if (!paceAllow(now)) {
+                    paced = true;
+                    break;
+                }
+                // 槽位只存头部，数据指向映射区中对应的偏移，校验和直接在映射区上计算
+                sender::Unacked& u = sender::winRing.insert(sender::nextSeq);
+                uint16_t len = static_cast<uint16_t>(std::min<uint32_t>(MSS, sender::fileSize - sender::nextSeq));
+                RdtPacket pkt = makeDataPkt(sender::nextSeq, len);
+                u.payload = sender::src.data() + sender::nextSeq;
+                RdtProtocolHelper::writeHeader(pkt, u.hdr, u.payload);
+                u.dataLen = len;
+                u.txCount = 0;
+                u.sacked = false;
+                u.retx = false;
+                u.timer.key = sender::nextSeq;
+                transmit(u);
                 sender::nextSeq += pkt.data_len;
                 canSend -= pkt.data_len;
             }
+            // 槽位里的报文在持锁期间不会被确认释放，flush 前指针一直有效
+            out.flush();
+            updatePersist();
+            traceCwnd();
+            
+            wakeAt = sender::t0 + ms(sender::wheel.nextExpire());
+            if (paced) wakeAt = std::min(wakeAt, sender::paceNext);
         }
         
-        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        waitSender(wakeAt);
     }
     
-    // fin
-    sendPkt(makeFinPkt(sender::nextSeq));
-    WaitForSingleObject(hRecv, 2000);
+    // fin：FIN 或 FIN_ACK 丢失时定期重发，最多等 FIN_WAIT_MS
+    for (unsigned waited = 0; !sender::finAcked && waited < cfg::FIN_WAIT_MS; waited += cfg::FIN_RETRY_MS) {
+        sendPkt(makeFinPkt(sender::nextSeq));
+        clock_type::time_point until = clock_type::now() + ms(cfg::FIN_RETRY_MS);
+        while (!sender::finAcked && clock_type::now() < until) waitSender(until);
+    }
+    sender::stop = true;
+    recv.join();
+    sender::batch = nullptr;
+    sender::sendCalls += out.syscalls();
     
     // result
-    auto dur = std::chrono::duration_cast<ms>(clock_type::now() - sender::t0).count();
-    double thr = static_cast<double>(sender::fileSize * 8) / dur * 1000 / (1024 * 1024);
+    // 小文件只要几毫秒，按小数毫秒计时
+    double dur = std::chrono::duration<double, std::milli>(clock_type::now() - sender::t0).count();
+    double thr = static_cast<double>(sender::fileSize) * 8 / dur * 1000 / (1024 * 1024);
     
     cout << "\n========== Result ==========\n";
+    cout << "CC : " << sender::cc->name() << (sender::opt.pacing ? " (paced)" : "") << "\n";
     cout << "FileSize : " << sender::fileSize << " bytes\n";
+    cout << std::fixed << std::setprecision(3);
     cout << "Time : " << dur << " ms\n";
-    cout << "Throughput: " << std::fixed << std::setprecision(3) << thr << " Mbps\n";
+    cout << "Throughput: " << thr << " Mbps\n";
+    cout << "Retrans : " << sender::retransmits << " (srtt " << sender::srtt << " ms, rto " << sender::rtoMs << " ms)\n";
+    cout << "Probes : " << sender::probes << "\n";
+    cout << "Syscalls : send " << sender::sendCalls << ", recv " << sender::recvCalls << "\n";
+    
+    if (!sender::opt.trace.empty() && !writeTrace(sender::opt.trace)) {
+        cerr << "Failed to write trace " << sender::opt.trace << endl;
+    }
     
     // cleanup
-    CloseHandle(hRecv);
-    DeleteCriticalSection(&sender::csReno);
-    DeleteCriticalSection(&sender::csSR);
     closesocket(sender::sock);
-    WSACleanup();
+    net_cleanup();
     
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+// seq_ring.hpp -- 按序号索引的定长环形窗口，发送端存在途报文段，接收端存乱序报文段
+// 序号为 unit（MSS）的整数倍，槽位下标为 (seq / unit) % 容量；窗口跨度不超过容量时不同序号不会冲突。
+// 槽位预先分配，插入、查找、删除都是 O(1)；占用情况记在位图里，遍历时整字跳过空槽。
+// 每个槽记下自己的序号，窗口外的查询（例如越界的 SACK 位）不会误中同下标的其他报文段
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// 最低位的 1 所在位置，x 不为 0
+inline unsigned ring_ctz(std::uint64_t x) {
+#ifdef _MSC_VER
+    unsigned long i;
+    _BitScanForward64(&i, x);
+    return static_cast<unsigned>(i);
+#else
+    return static_cast<unsigned>(__builtin_ctzll(x));
+#endif
+}
+
+template <class T>
+class SeqRing {
+public:
+    // 容量向上取整到 2 的幂，且至少 64（位图一个字）
+    SeqRing(std::size_t capacity, std::uint32_t unit) : unit_(unit) {
+        std::size_t cap = 64;
+        while (cap < capacity) cap <<= 1;
+        mask_ = cap - 1;
+        slots_.reset(new T[cap]);
+        seqs_.assign(cap, 0);
+        used_.assign(cap / 64, 0);
+    }
+
+    SeqRing(const SeqRing&) = delete;
+    SeqRing& operator=(const SeqRing&) = delete;
+
+    std::size_t capacity() const { return mask_ + 1; }
+    std::size_t size() const { return count_; }
+    bool empty() const { return count_ == 0; }
+
+    // 占用 seq 对应的槽位并返回它；槽位里是上一次使用留下的内容，由调用方初始化
+    T& insert(std::uint32_t seq) {
+        std::size_t i = index(seq);
+        if (!test(i)) {
+            used_[i >> 6] |= 1ull << (i & 63);
+            ++count_;
+        }
+        seqs_[i] = seq;
+        return slots_[i];
+    }
+
+    T* find(std::uint32_t seq) {
+        std::size_t i = index(seq);
+        return test(i) && seqs_[i] == seq ? &slots_[i] : nullptr;
+    }
+
+    bool contains(std::uint32_t seq) { return find(seq) != nullptr; }
+
+    void erase(std::uint32_t seq) {
+        std::size_t i = index(seq);
+        if (!test(i) || seqs_[i] != seq) return;
+        used_[i >> 6] &= ~(1ull << (i & 63));
+        --count_;
+    }
+
+    // 按序号从小到大访问 [from, to) 内已占用的槽位，f(seq, T&) 中可以删除当前槽位
+    template <class F>
+    void for_each(std::uint32_t from, std::uint32_t to, F&& f) {
+        for (std::uint32_t seq = from; seq < to;) {
+            std::size_t i = index(seq);
+            std::uint64_t word = used_[i >> 6] >> (i & 63);
+            if (word == 0) {
+                std::uint32_t next = seq + static_cast<std::uint32_t>(64 - (i & 63)) * unit_;
+                if (next < seq) break;  // 序号回绕
+                seq = next;
+                continue;
+            }
+            unsigned skip = ring_ctz(word);
+            seq += skip * unit_;
+            if (seq >= to) break;
+            i += skip;
+            if (seqs_[i] == seq) f(seq, slots_[i]);
+            seq += unit_;
+        }
+    }
+
+private:
+    std::size_t index(std::uint32_t seq) const { return (seq / unit_) & mask_; }
+    bool test(std::size_t i) const { return (used_[i >> 6] >> (i & 63)) & 1; }
+
+    std::uint32_t unit_;
+    std::size_t mask_ = 0;
+    std::size_t count_ = 0;
+    std::unique_ptr<T[]> slots_;
+    std::vector<std::uint32_t> seqs_;
+    std::vector<std::uint64_t> used_;
+};
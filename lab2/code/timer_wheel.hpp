@@ -0,0 +1,103 @@
+#pragma once
+
+// timer_wheel.hpp -- 哈希时间轮：每个在途报文段一个定时器，启动和取消都是 O(1)
+// 时间按 tick 计（发送端 1 tick = 1 ms），到期 tick 对槽数取模决定放在哪个槽，
+// 每个槽是一条双向循环链表，节点嵌在报文段记录里，不额外分配内存。
+// 超过一圈的定时器留在槽里，推进到该槽时比较到期时间，未到期的跳过
+
+#include <cstddef>
+#include <cstdint>
+
+#define TIMER_WHEEL_SLOTS 1024  // 必须是 2 的幂
+
+struct TimerNode {
+    TimerNode* prev = nullptr;  // 未启动时为空
+    TimerNode* next = nullptr;
+    std::uint64_t expire = 0;   // 到期 tick
+    std::uint32_t key = 0;      // 到期时交给回调，发送端为报文段序号
+
+    TimerNode() = default;
+    // 链表指针不能随对象拷贝
+    TimerNode(const TimerNode&) = delete;
+    TimerNode& operator=(const TimerNode&) = delete;
+
+    bool armed() const { return prev != nullptr; }
+};
+
+class TimerWheel {
+public:
+    explicit TimerWheel(std::uint64_t now = 0) : now_(now) {
+        for (TimerNode& s : slots_) s.prev = s.next = &s;
+        pending_.prev = pending_.next = &pending_;
+    }
+
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+
+    // 启动（或重新启动）定时器，expire 早于当前时间时在下一次推进时到期
+    void arm(TimerNode& n, std::uint64_t expire) {
+        cancel(n);
+        n.expire = expire > now_ ? expire : now_ + 1;
+        link(slots_[n.expire & (TIMER_WHEEL_SLOTS - 1)], n);
+    }
+
+    void cancel(TimerNode& n) {
+        if (!n.armed()) return;
+        n.prev->next = n.next;
+        n.next->prev = n.prev;
+        n.prev = n.next = nullptr;
+    }
+
+    // 推进到 now，对每个到期的定时器调用 fire(key)。
+    // 回调里可以重新启动或取消任意定时器（包括本轮其他待触发的）
+    template <class F>
+    void advance(std::uint64_t now, F&& fire) {
+        if (now <= now_) return;
+        // 超过一圈时每个槽只需要看一次
+        std::uint64_t from = now - now_ > TIMER_WHEEL_SLOTS ? now - TIMER_WHEEL_SLOTS + 1 : now_ + 1;
+        for (std::uint64_t t = from; t <= now; ++t) {
+            TimerNode& head = slots_[t & (TIMER_WHEEL_SLOTS - 1)];
+            for (TimerNode* n = head.next; n != &head;) {
+                TimerNode* next = n->next;
+                if (n->expire <= now) {
+                    cancel(*n);
+                    link(pending_, *n);
+                }
+                n = next;
+            }
+        }
+        now_ = now;
+        // 到期的先移到待触发链表再逐个回调，回调修改其他定时器时链表仍然有效
+        while (pending_.next != &pending_) {
+            TimerNode* n = pending_.next;
+            cancel(*n);
+            fire(n->key);
+        }
+    }
+
+    // 最早到期的 tick，从下一 tick 起最多往后看 horizon 个 tick，都没有时返回 now + horizon。
+    // 只逐槽检查，不需要额外维护最小堆；调用方用它决定能睡多久
+    std::uint64_t nextExpire(std::uint64_t horizon = TIMER_WHEEL_SLOTS) const {
+        for (std::uint64_t t = now_ + 1; t <= now_ + horizon; ++t) {
+            const TimerNode& head = slots_[t & (TIMER_WHEEL_SLOTS - 1)];
+            for (const TimerNode* n = head.next; n != &head; n = n->next) {
+                if (n->expire <= t) return t;
+            }
+        }
+        return now_ + horizon;
+    }
+
+    std::uint64_t now() const { return now_; }
+
+private:
+    static void link(TimerNode& head, TimerNode& n) {
+        n.prev = &head;
+        n.next = head.next;
+        head.next->prev = &n;
+        head.next = &n;
+    }
+
+    TimerNode slots_[TIMER_WHEEL_SLOTS];
+    TimerNode pending_;
+    std::uint64_t now_;
+};